@@ -0,0 +1,120 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * Compares tower target acquisition using SpatialGrid against the linear scan
+ * over all creep it replaced. Both must select the exact same targets.
+ *
+ * usage: bench_spatial [CREEP] [TOWERS] [ITERATIONS]
+ */
+
+#include "spatial.hpp"
+#include "vector.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/time.h>
+
+/* maul.frob dimensions */
+static const size_t map_width  = 48;
+static const size_t map_height = 48;
+static const float  tile_size  = 48.0f;
+
+struct Object {
+	Vector2f pos;
+};
+
+static uint64_t wallclock(){
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return (uint64_t)t.tv_sec * 1000000 + t.tv_usec;
+}
+
+static float frand(float max){
+	return (float)rand() / RAND_MAX * max;
+}
+
+static const Object* linear(const std::vector<Object>& creep, const Vector2f& pos, float range){
+	const Object* found = NULL;
+	float current = range;
+
+	for ( auto it = creep.begin(); it != creep.end(); ++it ){
+		const float distance = Vector2f::distance(pos, it->pos);
+		if ( distance < current ){
+			found = &*it;
+			current = distance;
+		}
+	}
+
+	return found;
+}
+
+int main(int argc, const char* argv[]){
+	const size_t num_creep  = argc > 1 ? atoi(argv[1]) : 500;
+	const size_t num_towers = argc > 2 ? atoi(argv[2]) : 200;
+	const size_t iterations = argc > 3 ? atoi(argv[3]) : 100;
+
+	std::vector<Object> creep(num_creep);
+	std::vector<Object> tower(num_towers);
+	std::vector<float> range(num_towers);
+	SpatialGrid<const Object> grid;
+	grid.resize(map_width, map_height, Vector2f(tile_size, tile_size));
+
+	srand(4711);
+	const float w = map_width * tile_size;
+	const float h = map_height * tile_size;
+	for ( auto it = tower.begin(); it != tower.end(); ++it ){
+		it->pos = Vector2f(frand(w), frand(h));
+	}
+	for ( auto it = range.begin(); it != range.end(); ++it ){
+		*it = 150.0f + frand(150.0f);
+	}
+
+	uint64_t t_linear = 0;
+	uint64_t t_build = 0;
+	uint64_t t_query = 0;
+	size_t hits = 0;
+	std::vector<const Object*> expected(num_towers);
+
+	for ( size_t i = 0; i < iterations; i++ ){
+		/* creep move every tick so positions are regenerated each iteration */
+		for ( auto it = creep.begin(); it != creep.end(); ++it ){
+			it->pos = Vector2f(frand(w), frand(h));
+		}
+
+		uint64_t t0 = wallclock();
+		for ( size_t j = 0; j < num_towers; j++ ){
+			expected[j] = linear(creep, tower[j].pos, range[j]);
+		}
+
+		uint64_t t1 = wallclock();
+		for ( auto it = creep.begin(); it != creep.end(); ++it ){
+			grid.insert(&*it, it->pos);
+		}
+		grid.build();
+
+		uint64_t t2 = wallclock();
+		for ( size_t j = 0; j < num_towers; j++ ){
+			const Object* found = grid.nearest(tower[j].pos, range[j]);
+			if ( found != expected[j] ){
+				fprintf(stderr, "mismatch at iteration %zd tower %zd\n", i, j);
+				return 1;
+			}
+			hits += found ? 1 : 0;
+		}
+		uint64_t t3 = wallclock();
+
+		t_linear += t1 - t0;
+		t_build  += t2 - t1;
+		t_query  += t3 - t2;
+	}
+
+	printf("%zd creep, %zd towers, %zd iterations (%zd targets found)\n", num_creep, num_towers, iterations, hits);
+	printf("  linear scan: %8.3f ms/tick\n", t_linear / 1000.0 / iterations);
+	printf("  grid build:  %8.3f ms/tick\n", t_build  / 1000.0 / iterations);
+	printf("  grid query:  %8.3f ms/tick\n", t_query  / 1000.0 / iterations);
+	printf("  speedup:     %8.1fx\n", (double)t_linear / (t_build + t_query));
+
+	return 0;
+}
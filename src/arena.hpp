@@ -0,0 +1,77 @@
+#ifndef FROBNICATOR_ARENA_H
+#define FROBNICATOR_ARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/**
+ * Fixed capacity storage for objects which are created together and die
+ * around the same time, e.g. the creep of a wave. Creating an object bumps a
+ * pointer and the storage is released in one go when the arena is deleted,
+ * destroying an object only runs its destructor.
+ *
+ * The arena does not know which objects are alive so all objects must have
+ * been destroyed before the arena is deleted, destroy() tells when the last
+ * one goes.
+ */
+template <class T>
+class Arena {
+public:
+	explicit Arena(size_t capacity)
+		: storage(static_cast<char*>(::operator new(capacity * sizeof(T))))
+		, capacity(capacity)
+		, used(0)
+		, live(0) {}
+
+	~Arena(){
+		assert(live == 0);
+		::operator delete(storage);
+	}
+
+	/**
+	 * Construct a new object.
+	 * @return NULL if the arena is full.
+	 */
+	template <typename... Args>
+	T* create(Args&&... args){
+		if ( full() ) return NULL;
+		T* obj = new (storage + used * sizeof(T)) T(std::forward<Args>(args)...);
+		used++;
+		live++;
+		return obj;
+	}
+
+	/**
+	 * Destroy an object created by this arena. The memory is not reused.
+	 * @return true if no objects are left.
+	 */
+	bool destroy(T* obj){
+		assert(live > 0);
+		obj->~T();
+		return --live == 0;
+	}
+
+	bool full() const {
+		return used == capacity;
+	}
+
+	/**
+	 * Number of objects not yet destroyed.
+	 */
+	size_t size() const {
+		return live;
+	}
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	char* storage;
+	const size_t capacity;
+	size_t used;  /* objects created */
+	size_t live;  /* objects not yet destroyed */
+};
+
+#endif /* FROBNICATOR_ARENA_H */
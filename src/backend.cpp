@@ -4,8 +4,6 @@
 
 #include "backend.hpp"
 
-Backend::map Backend::factory_map;
-
 Backend::Backend(){
 
 }
@@ -14,12 +12,25 @@ Backend::~Backend(){
 
 }
 
+Backend::map& Backend::factory_map(){
+	static map factories;
+	return factories;
+}
+
 void Backend::register_factory(const std::string& name, Backend::factory_callback func){
-	factory_map[name] = func;
+	factory_map()[name] = func;
 }
 
 Backend* Backend::create(const std::string& name){
-	auto it = factory_map.find(name);
-	if ( it == factory_map.end() ) return NULL;
+	auto it = factory_map().find(name);
+	if ( it == factory_map().end() ) return NULL;
 	return it->second();
 }
+
+std::vector<std::string> Backend::available(){
+	std::vector<std::string> names;
+	for ( auto it = factory_map().begin(); it != factory_map().end(); ++it ){
+		names.push_back(it->first);
+	}
+	return names;
+}
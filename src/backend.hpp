@@ -6,6 +6,7 @@
 #include <vector>
 #include <functional>
 #include "color.hpp"
+#include "snapshot.hpp"
 #include "vector.hpp"
 
 class RenderTarget {
@@ -48,11 +49,21 @@ public:
 	virtual void render_clear(const Color& color) const = 0;
 	virtual void render_sprite(const Vector2i pos, const Sprite* sprite, const Color& color = Color::white) const = 0;
 	virtual void render_tilemap(const Tilemap& tilemap, const Vector2f& camera) const = 0;
+
+	/**
+	 * Render a low-detail overview of the entire tilemap, scaled to fit the
+	 * given screen rectangle.
+	 */
+	virtual void render_overview(const Tilemap& tilemap, const Vector2i& pos, const Vector2i& size) const = 0;
 	virtual void render_marker(const Vector2f& pos, const Vector2f& camera, const bool v[]) const = 0;
 	virtual void FROB_NONNULL(1) render_region(const Region* region, const Vector2f& camera, float color[3]) const = 0;
-	virtual void FROB_NONNULL(1) render_region(const Entity* region, const Vector2f& camera, float color[3]) const = 0;
-	virtual void render_entities(std::vector<Entity*>& entities, const Vector2f& camera) const = 0;
-	virtual void render_projectiles(std::vector<Projectile*>& projectiles, const Vector2f& camera) const = 0;
+	virtual void FROB_NONNULL(1) render_region(const Snapshot::Entity* region, const Vector2f& camera, float color[3]) const = 0;
+
+	/**
+	 * Render entities (and healthbars) in the given order at pos.
+	 */
+	virtual void render_entities(const std::vector<Snapshot::Entity>& entities, const Vector2f& camera) const = 0;
+	virtual void render_projectiles(const std::vector<Snapshot::Projectile>& projectiles, const Vector2f& camera) const = 0;
 	virtual void FROB_NONNULL(1) render_target(RenderTarget* target, const Vector2i& offset) const = 0;
 	virtual void render_lines(const Color& color, float width, const Vector2f* points, unsigned int n) const = 0;
 	virtual void render_end() = 0;
@@ -86,15 +97,21 @@ public:
 	 */
 	static Backend* create(const std::string& name);
 
+	/**
+	 * Names of all registered backends.
+	 */
+	static std::vector<std::string> available();
+
 protected:
 	Backend();
 
 private:
-	static map factory_map;
+	/* function-local static as backends register during static initialization */
+	static map& factory_map();
 };
 
 #define REGISTER_BACKEND(cls)	\
-	class SI { public: SI(){ Backend::register_factory(#cls, cls::factory); } }; \
-	static SI si
+	namespace { class SI_##cls { public: SI_##cls(){ Backend::register_factory(#cls, cls::factory); } }; } \
+	static SI_##cls si_##cls
 
 #endif /* DVB021_BACKEND_H */
@@ -0,0 +1,195 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "backend.hpp"
+#include "common.hpp"
+#include "sprite.hpp"
+#include "tilemap.hpp"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+/**
+ * Read image dimensions from PNG or JPEG headers without decoding any pixels.
+ * @return false if the file could not be read or the format is not recognized.
+ */
+static bool image_size(const std::string& filename, size_t* width, size_t* height){
+	const char* real_filename = real_path(filename.c_str());
+	FILE* fp = fopen(real_filename, "rb");
+	if ( !fp ){
+		return false;
+	}
+
+	unsigned char buf[24];
+	if ( fread(buf, 1, 4, fp) != 4 ){
+		fclose(fp);
+		return false;
+	}
+
+	bool found = false;
+
+	/* PNG: width and height are the first fields in IHDR (big-endian) */
+	if ( buf[0] == 0x89 && buf[1] == 'P' && buf[2] == 'N' && buf[3] == 'G' ){
+		if ( fread(buf + 4, 1, 20, fp) == 20 ){
+			*width  = (buf[16] << 24) | (buf[17] << 16) | (buf[18] << 8) | buf[19];
+			*height = (buf[20] << 24) | (buf[21] << 16) | (buf[22] << 8) | buf[23];
+			found = true;
+		}
+	}
+
+	/* JPEG: walk the segments until a start-of-frame marker is found */
+	else if ( buf[0] == 0xFF && buf[1] == 0xD8 ){
+		fseek(fp, 2, SEEK_SET);
+		while ( fread(buf, 1, 4, fp) == 4 && buf[0] == 0xFF ){
+			const unsigned char marker = buf[1];
+			const long len = (buf[2] << 8) | buf[3];
+
+			/* SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC) */
+			if ( marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC ){
+				if ( fread(buf, 1, 5, fp) == 5 ){
+					*height = (buf[1] << 8) | buf[2];
+					*width  = (buf[3] << 8) | buf[4];
+					found = true;
+				}
+				break;
+			}
+
+			fseek(fp, len - 2, SEEK_CUR);
+		}
+	}
+
+	fclose(fp);
+	return found;
+}
+
+/**
+ * Lookup texture size, using the same fallback as the SDL backend when the
+ * image is missing.
+ */
+static void texture_size(const std::string& filename, size_t* width, size_t* height){
+	static std::map<std::string, std::pair<size_t, size_t> > cache;
+	static std::recursive_mutex lock; /* sprites are loaded from loader threads */
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	auto it = cache.find(filename);
+	if ( it != cache.end() ){
+		*width  = it->second.first;
+		*height = it->second.second;
+		return;
+	}
+
+	if ( !image_size(filename, width, height) ){
+		fprintf(stderr, "failed to load texture `%s'\n", filename.c_str());
+
+		static const char* default_texture = "default.png";
+		if ( filename == default_texture ) abort();
+		texture_size(default_texture, width, height);
+	}
+
+	cache[filename] = std::make_pair(*width, *height);
+}
+
+class NullTilemap: public Tilemap {
+public:
+	NullTilemap(const std::string& filename)
+		: Tilemap(filename) {
+
+		size_t w,h;
+		texture_size(texture_filename(), &w, &h);
+		set_dimensions(w,h);
+	}
+};
+
+class NullSprite: public Sprite {
+public:
+	NullSprite(const Sprite* base)
+		: Sprite(base)
+		, width(0)
+		, height(0) {
+
+		if ( base ){
+			const NullSprite* _ = static_cast<const NullSprite*>(base);
+			width  = _->width;
+			height = _->height;
+		}
+	}
+
+	virtual Sprite* load_texture(const std::string& filename){
+		texture_size(filename, &width, &height);
+		return set_scale(Vector2f(width, height));
+	}
+
+	virtual Sprite* autoscale(){
+		return set_scale(Vector2f(width, height));
+	}
+
+	size_t width;
+	size_t height;
+};
+
+class NullRenderTarget: public RenderTarget {
+public:
+	virtual void bind(){}
+	virtual void unbind(){}
+};
+
+class NullFont: public Font {
+public:
+	virtual void printf(int x, int y, const Color& color, const char* fmt, ...) const {}
+	virtual void vprintf(int x, int y, const Color& color, const char* fmt, va_list ap) const {}
+};
+
+/**
+ * Backend without any window or rendering, used to run the simulation on
+ * machines without a display. Everything with a size reports the same
+ * dimensions as the SDL backend would so the simulation behaves identically.
+ */
+class NullBackend: public Backend {
+public:
+	virtual ~NullBackend(){
+
+	}
+
+	virtual void init(const Vector2i& size){}
+	virtual void poll(bool& running){}
+	virtual void cleanup(){}
+	virtual void bindkey(const std::string& key, std::function<void()> func){}
+
+	virtual void render_begin(RenderTarget* target){}
+	virtual void render_clear(const Color& color) const {}
+	virtual void render_sprite(const Vector2i pos, const Sprite* sprite, const Color& color) const {}
+	virtual void render_tilemap(const Tilemap& tilemap, const Vector2f& camera) const {}
+	virtual void render_overview(const Tilemap& tilemap, const Vector2i& pos, const Vector2i& size) const {}
+	virtual void render_marker(const Vector2f& pos, const Vector2f& camera, const bool v[]) const {}
+	virtual void render_region(const Region* region, const Vector2f& camera, float color[3]) const {}
+	virtual void render_region(const Snapshot::Entity* region, const Vector2f& camera, float color[3]) const {}
+	virtual void render_entities(const std::vector<Snapshot::Entity>& entities, const Vector2f& camera) const {}
+	virtual void render_projectiles(const std::vector<Snapshot::Projectile>& projectiles, const Vector2f& camera) const {}
+	virtual void render_target(RenderTarget* target, const Vector2i& offset) const {}
+	virtual void render_lines(const Color& color, float width, const Vector2f* points, unsigned int n) const {}
+	virtual void render_end(){}
+
+	static Backend* factory(){
+		return new NullBackend;
+	}
+
+	virtual Tilemap* load_tilemap(const std::string& filename){
+		return new NullTilemap(filename);
+	}
+
+	virtual Sprite* create_sprite(const Sprite* base){
+		return new NullSprite(base);
+	}
+
+	virtual RenderTarget* create_rendertarget(const Vector2i& size, bool alpha){
+		return new NullRenderTarget;
+	}
+
+	virtual Font* create_font(const std::string& filename){
+		return new NullFont;
+	}
+};
+
+REGISTER_BACKEND(NullBackend);
@@ -14,16 +14,22 @@
 #include "tilemap.hpp"
 #include "game.hpp"
 #include "common.hpp"
-#include "entity.hpp"
 #include "region.hpp"
 #include "sprite.hpp"
+#include "sprite_batch.hpp"
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
 #include <GL/glew.h>
 #include <math.h>
 #include <map>
+#include <list>
+#include <unordered_map>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
 
 typedef struct {
 	float x;
@@ -45,85 +51,345 @@ static Vector2i size;
 
 static int video_flags = SDL_OPENGL|SDL_DOUBLEBUF|SDL_RESIZABLE;
 
-static GLuint load_texture(const std::string filename, size_t* width, size_t* height) {
-	const char* real_filename = real_path(filename.c_str());
+/**
+ * Sprite images packed into a few large textures so sprites drawn together
+ * share a texture and batch into few draw calls.
+ *
+ * Images are placed when they are uploaded using a shelf packer: images are
+ * put left to right on a shelf as tall as the tallest image on it, when the
+ * shelf is full a new one is opened below and when the page is full a new
+ * page is started. Each image gets a border copied from its edges so linear
+ * filtering never picks up a neighbour. Every page also has a small white
+ * area for untextured quads (e.g. healthbars) so they don't need another
+ * texture either.
+ */
+class Atlas {
+public:
+	static const size_t page_size = 1024;
+	static const size_t border = 1;
+	static const size_t white_size = 4;
+
+	struct Region {
+		GLuint page;
+		Vector2f uv0;
+		Vector2f uv1;
+	};
+
+	/**
+	 * Pack an RGBA image and upload it. Main thread only.
+	 * @return false if the image does not fit on a page.
+	 */
+	bool insert(size_t width, size_t height, const char* pixels, Region* region){
+		const size_t w = width  + 2 * border;
+		const size_t h = height + 2 * border;
+		if ( w > page_size || h > page_size - white_size ){ /* must fit below the white area */
+			return false;
+		}
 
-	/* borrowed from blueflower/opengta */
+		size_t x, y;
+		while ( pages.empty() || !pages.back().place(w, h, &x, &y) ){
+			add_page();
+		}
+
+		/* copy with border, edge pixels are repeated outwards */
+		padded.resize(4 * w * h);
+		for ( size_t py = 0; py < h; py++ ){
+			const size_t sy = std::min(std::max(py, border) - border, height - 1);
+			for ( size_t px = 0; px < w; px++ ){
+				const size_t sx = std::min(std::max(px, border) - border, width - 1);
+				memcpy(&padded[4 * (py * w + px)], &pixels[4 * (sy * width + sx)], 4);
+			}
+		}
+
+		const Page& page = pages.back();
+		glBindTexture(GL_TEXTURE_2D, page.id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, padded.data());
+
+		const float scale = 1.0f / page_size;
+		region->page = page.id;
+		region->uv0 = Vector2f((x + border) * scale, (y + border) * scale);
+		region->uv1 = Vector2f((x + border + width) * scale, (y + border + height) * scale);
+		return true;
+	}
+
+	/**
+	 * White area for untextured quads. Main thread only.
+	 */
+	const Region& white(){
+		if ( pages.empty() ){
+			add_page();
+		}
+		return pages.front().white;
+	}
+
+private:
+	struct Page {
+		bool place(size_t w, size_t h, size_t* x, size_t* y){
+			if ( shelf_x + w > page_size ){
+				/* open a new shelf */
+				shelf_y += shelf_h;
+				shelf_x = 0;
+				shelf_h = 0;
+			}
+			if ( shelf_y + h > page_size ){
+				return false;
+			}
+
+			*x = shelf_x;
+			*y = shelf_y;
+			shelf_x += w;
+			shelf_h = std::max(shelf_h, h);
+			return true;
+		}
+
+		GLuint id;
+		size_t shelf_x;
+		size_t shelf_y;
+		size_t shelf_h;
+		Region white;
+	};
+
+	void add_page(){
+		Page page;
+		page.shelf_x = 0;
+		page.shelf_y = 0;
+		page.shelf_h = 0;
+
+		/* no anisotropic filtering, its taps would reach past the border into
+		 * neighbouring images (sprites are drawn screen-aligned anyway) */
+		glGenTextures(1, &page.id);
+		glBindTexture(GL_TEXTURE_2D, page.id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page_size, page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+		/* white area in the first slot, sampled at its middle */
+		size_t x, y;
+		page.place(white_size, white_size, &x, &y);
+		const std::vector<char> white(4 * white_size * white_size, (char)0xFF);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, white_size, white_size, GL_RGBA, GL_UNSIGNED_BYTE, white.data());
+		const float middle = (white_size / 2) / (float)page_size;
+		page.white.page = page.id;
+		page.white.uv0 = page.white.uv1 = Vector2f(x / (float)page_size + middle, y / (float)page_size + middle);
+
+		fprintf(stderr, "Allocated %zux%zu texture atlas page %zu\n", page_size, page_size, pages.size() + 1);
+		pages.push_back(page);
+	}
+
+	std::vector<Page> pages;
+	std::vector<char> padded; /* scratch */
+};
 
-	/* Load image using SDL Image */
-	SDL_Surface* surface = IMG_Load(real_filename);
-	if ( !surface ){
-		fprintf(stderr, "failed to load texture `%s'\n", filename.c_str());
+static Atlas atlas;
 
-		static const char* default_texture = "default.png";
-		if ( filename == default_texture ) abort();
-		return load_texture(default_texture, width, height);
+/**
+ * Image decoded to RGBA and uploaded to GL on first use. Decoding may happen
+ * on any thread (e.g. loader threads) while uploading must happen on the main
+ * thread as it owns the GL context, decoded pixels are kept until then.
+ */
+class Texture {
+public:
+	Texture()
+		: width(0)
+		, height(0)
+		, clamp(false)
+		, packed(false)
+		, decoded(false)
+		, uv0(0,0)
+		, uv1(1,1)
+		, id(0)
+		, in_atlas(false) {}
+
+	~Texture(){
+		if ( id && !in_atlas ){
+			glDeleteTextures(1, &id);
+		}
 	}
 
-	/* To properly support all formats the surface must be copied to a new
-	 * surface with a prespecified pixel format suitable for opengl.
-	 *
-	 * This snippet is a slightly modified version of code posted by
-	 * Sam Lantinga to the SDL mailinglist at Sep 11 2002.
+	/**
+	 * Decode an image, falls back to default.png if it cannot be loaded.
 	 */
-	SDL_Surface* rgba_surface = SDL_CreateRGBSurface(
-		SDL_SWSURFACE,
-		surface->w, surface->h,
-		32,
+	void decode(const std::string& filename){
+		const char* real_filename = real_path(filename.c_str());
+
+		/* borrowed from blueflower/opengta */
+
+		/* Load image using SDL Image */
+		SDL_Surface* surface = IMG_Load(real_filename);
+		if ( !surface ){
+			fprintf(stderr, "failed to load texture `%s'\n", filename.c_str());
+
+			static const char* default_texture = "default.png";
+			if ( filename == default_texture ) abort();
+			decode(default_texture);
+			return;
+		}
+
+		/* To properly support all formats the surface must be copied to a new
+		 * surface with a prespecified pixel format suitable for opengl. The
+		 * new surface uses our buffer so the pixels can be kept for uploading.
+		 *
+		 * This snippet is a slightly modified version of code posted by
+		 * Sam Lantinga to the SDL mailinglist at Sep 11 2002.
+		 */
+		pixels.resize(4 * surface->w * surface->h);
+		SDL_Surface* rgba_surface = SDL_CreateRGBSurfaceFrom(
+			pixels.data(),
+			surface->w, surface->h,
+			32, 4 * surface->w,
 #if SDL_BYTEORDER == SDL_LIL_ENDIAN /* OpenGL RGBA masks */
-		0x000000FF,
-		0x0000FF00,
-		0x00FF0000,
-		0xFF000000
+			0x000000FF,
+			0x0000FF00,
+			0x00FF0000,
+			0xFF000000
 #else
-		0xFF000000,
-		0x00FF0000,
-		0x0000FF00,
-		0x000000FF
+			0xFF000000,
+			0x00FF0000,
+			0x0000FF00,
+			0x000000FF
 #endif
-		);
+			);
 
-	if ( !rgba_surface ) {
-		fprintf(stderr, "Failed to create RGBA surface");
-		abort();
-	}
+		if ( !rgba_surface ) {
+			fprintf(stderr, "Failed to create RGBA surface");
+			abort();
+		}
+
+		/* Save the alpha blending attributes */
+		Uint32 saved_flags = surface->flags&(SDL_SRCALPHA|SDL_RLEACCELOK);
+		Uint8 saved_alpha = surface->format->alpha;
+		if ( (saved_flags & SDL_SRCALPHA) == SDL_SRCALPHA ) {
+			SDL_SetAlpha(surface, 0, 0);
+		}
 
-	/* Save the alpha blending attributes */
-	Uint32 saved_flags = surface->flags&(SDL_SRCALPHA|SDL_RLEACCELOK);
-	Uint8 saved_alpha = surface->format->alpha;
-	if ( (saved_flags & SDL_SRCALPHA) == SDL_SRCALPHA ) {
-		SDL_SetAlpha(surface, 0, 0);
+		SDL_BlitSurface(surface, 0, rgba_surface, 0);
+
+		/* Restore the alpha blending attributes */
+		if ( (saved_flags & SDL_SRCALPHA) == SDL_SRCALPHA ) {
+			SDL_SetAlpha(surface, saved_flags, saved_alpha);
+		}
+
+		width  = rgba_surface->w;
+		height = rgba_surface->h;
+
+		SDL_FreeSurface(rgba_surface);
+		SDL_FreeSurface(surface);
 	}
 
-	SDL_BlitSurface(surface, 0, rgba_surface, 0);
+	/**
+	 * Use already decoded RGBA pixels, the buffer is taken over.
+	 */
+	void set_pixels(size_t w, size_t h, std::vector<char>& data){
+		width = w;
+		height = h;
+		pixels.swap(data);
+	}
 
-	/* Restore the alpha blending attributes */
-	if ( (saved_flags & SDL_SRCALPHA) == SDL_SRCALPHA ) {
-		SDL_SetAlpha(surface, saved_flags, saved_alpha);
+	/**
+	 * GL texture, uploaded on first call. Main thread only.
+	 */
+	GLuint get() const {
+		if ( !id ){
+			upload();
+		}
+		return id;
 	}
 
+	/**
+	 * Texture coordinates of the image within get(), which is an atlas page
+	 * for packed textures. Main thread only.
+	 */
+	const Vector2f& uv_min() const { get(); return uv0; }
+	const Vector2f& uv_max() const { get(); return uv1; }
+
+	size_t width;
+	size_t height;
+	bool clamp;     /* clamp to edge instead of repeating */
+	bool packed;    /* place in the atlas if it fits */
+	bool decoded;   /* set once decoded, see cached_texture */
+
+private:
+	void upload() const {
+		Atlas::Region region;
+		if ( packed && atlas.insert(width, height, pixels.data(), &region) ){
+			id = region.page;
+			uv0 = region.uv0;
+			uv1 = region.uv1;
+			in_atlas = true;
+			std::vector<char>().swap(pixels);
+			return;
+		}
+
 #ifdef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
-	float maxAnisotropy;
-	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		float maxAnisotropy;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
 #endif
 
-	/* Generate texture and copy pixels to it */
-	GLuint texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		/* Generate texture and copy pixels to it */
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if ( clamp ){
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		} else {
 #ifdef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
 #endif
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rgba_surface->w, rgba_surface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_surface->pixels );
+		}
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+		/* release pixels */
+		std::vector<char>().swap(pixels);
+	}
+
+	mutable std::vector<char> pixels;
+	mutable Vector2f uv0;
+	mutable Vector2f uv1;
+	mutable GLuint id;
+	mutable bool in_atlas;
+};
+
+/**
+ * Hand a decoded texture to the main thread for uploading.
+ */
+static void upload_later(const Texture* texture){
+	Game::defer([texture](){ texture->get(); });
+}
+
+static std::map<std::string, Texture*> texture_cache;
+static std::mutex texture_lock;
+static std::condition_variable texture_decoded;
+
+/**
+ * Get texture shared by all sprites using the file, packed into the atlas.
+ * The first caller decodes it, concurrent callers for the same file wait for
+ * that.
+ */
+static const Texture* cached_texture(const std::string& filename){
+	std::unique_lock<std::mutex> guard(texture_lock);
+
+	auto it = texture_cache.find(filename);
+	if ( it != texture_cache.end() ){
+		const Texture* texture = it->second;
+		texture_decoded.wait(guard, [texture](){ return texture->decoded; });
+		return texture;
+	}
 
-	if ( width  ) *width  = rgba_surface->w;
-	if ( height ) *height = rgba_surface->h;
+	Texture* texture = new Texture;
+	texture->packed = true;
+	texture_cache[filename] = texture;
+	guard.unlock();
 
-	SDL_FreeSurface(rgba_surface);
-	SDL_FreeSurface(surface);
+	texture->decode(filename);
+	upload_later(texture);
 
+	guard.lock();
+	texture->decoded = true;
+	texture_decoded.notify_all();
 	return texture;
 }
 
@@ -137,72 +403,13 @@ static void setup_projection(const Vector2i resolution){
 	glMatrixMode(GL_MODELVIEW);
 }
 
-class SDLTilemap: public Tilemap {
-public:
-	SDLTilemap(const std::string& filename)
-		: Tilemap(filename) {
-
-		size_t w,h;
-		texture = load_texture(texture_filename(), &w, &h);
-		set_dimensions(w,h);
-
-		/* four vertices per tile (@todo use *strip for less vertices) */
-		vertices = (vertex*)malloc(sizeof(vertex)*4*size());
-		indices = (unsigned int*)malloc(sizeof(unsigned int)*4*size());
-
-		/* generate vertices */
-		fprintf(stderr, "  generating vertices\n");
-		unsigned int n = 0;
-		for ( auto it = begin(); it != end(); ++it ){
-			Tilemap::Tile& tile = *it;
-
-			vertices[n  ].x = (float)((tile.x  ) * tile_width());
-			vertices[n  ].y = (float)((tile.y  ) * tile_height());
-			vertices[n+1].x = (float)((tile.x+1) * tile_width());
-			vertices[n+1].y = (float)((tile.y  ) * tile_height());
-			vertices[n+2].x = (float)((tile.x+1) * tile_width());
-			vertices[n+2].y = (float)((tile.y+1) * tile_height());
-			vertices[n+3].x = (float)((tile.x  ) * tile_width());
-			vertices[n+3].y = (float)((tile.y+1) * tile_height());
-
-			/* unused z */
-			vertices[n  ].z = 0.0f;
-			vertices[n+1].z = 0.0f;
-			vertices[n+2].z = 0.0f;
-			vertices[n+3].z = 0.0f;
-
-			/* UV */
-			vertices[n  ].s = tile.uv[0];
-			vertices[n  ].t = tile.uv[1];
-			vertices[n+1].s = tile.uv[2];
-			vertices[n+1].t = tile.uv[3];
-			vertices[n+2].s = tile.uv[4];
-			vertices[n+2].t = tile.uv[5];
-			vertices[n+3].s = tile.uv[6];
-			vertices[n+3].t = tile.uv[7];
-
-			n += 4;
-		}
-
-		/* generate indices */
-		for ( unsigned int i = 0; i < 4 * size(); i++ ){
-			indices[i] = i;
-		}
-	}
-
-	GLuint texture;
-	vertex* vertices;
-	unsigned int* indices;
-
-};
-
-class SDLSprite;
-static std::map<std::string, SDLSprite*> texture_cache;
-
 class SDLSprite: public Sprite {
 public:
 	SDLSprite(const Sprite* base)
-	: Sprite(base) {
+	: Sprite(base)
+	, width(0)
+	, height(0)
+	, texture(nullptr) {
 		if ( base ){
 			const SDLSprite* _  = static_cast<const SDLSprite*>(base);
 			width   = _->width;
@@ -212,21 +419,14 @@ public:
 		}
 	}
 
+	/**
+	 * May be called from loader threads, the texture is uploaded later by the
+	 * main thread.
+	 */
 	virtual Sprite* load_texture(const std::string& filename){
-		/* search cache */
-		auto it = texture_cache.find(filename);
-		if ( it != texture_cache.end() ){
-			SDLSprite* c = it->second;
-			texture = c->texture;
-			width   = c->width;
-			height  = c->height;
-			set_scale(Vector2f(width, height));
-			return this;
-		}
-
-		/* load new texture */
-		texture = ::load_texture(filename, &width, &height);
-		texture_cache[filename] = this;
+		texture = cached_texture(filename);
+		width   = texture->width;
+		height  = texture->height;
 		set_scale(Vector2f(width, height));
 
 		return this;
@@ -236,9 +436,21 @@ public:
 		return set_scale(Vector2f(width, height));
 	}
 
+	GLuint texture_id() const {
+		return texture ? texture->get() : 0;
+	}
+
+	Vector2f uv_min() const {
+		return texture ? texture->uv_min() : Vector2f(0,0);
+	}
+
+	Vector2f uv_max() const {
+		return texture ? texture->uv_max() : Vector2f(1,1);
+	}
+
 	size_t width;
 	size_t height;
-	GLuint texture;
+	const Texture* texture;
 };
 
 class SDLRenderTarget: public RenderTarget {
@@ -309,6 +521,198 @@ public:
 
 SDLRenderTarget* SDLRenderTarget::current = nullptr;
 
+/**
+ * Tilemap geometry is split into square chunks which are streamed into
+ * static vertex buffers when they come into view. Only a bounded number of
+ * chunks are kept resident (least recently drawn are recycled first) so both
+ * the cost per frame and the memory use depend on the window size rather than
+ * the map size. Tiles themselves are read straight from the tilemap, which
+ * for compiled maps is paged in from disk on demand.
+ *
+ * A low-detail overview of the whole map is rendered once at load by
+ * streaming every chunk through a scratch buffer.
+ */
+class SDLTilemap: public Tilemap {
+public:
+	static const size_t chunk_size = 32;     /* tiles along each side */
+	static const size_t max_resident = 256;  /* chunks, about 20 MB of vertices */
+	static const size_t max_prefetch = 4;    /* chunks built ahead of the view per frame */
+	static const size_t overview_max = 1024; /* pixels along longest side */
+
+	struct Chunk {
+		GLuint vbo;
+		GLsizei num_vertices;
+	};
+
+	/**
+	 * The tileset is decoded on a loader thread while the rest of the level
+	 * loads. Tile dimensions and the overview are set up on the main thread
+	 * once it is done, i.e. by the loader's finish().
+	 */
+	SDLTilemap(const std::string& filename)
+		: Tilemap(filename)
+		, overview(nullptr) {
+
+		chunks_x = (map_width()  + chunk_size - 1) / chunk_size;
+		chunks_y = (map_height() + chunk_size - 1) / chunk_size;
+		buffer.reserve(4 * chunk_size * chunk_size);
+
+		Game::load_async([this](){
+			texture.decode(texture_filename());
+			Game::defer([this](){ finish_loading(); });
+		});
+	}
+
+	virtual ~SDLTilemap(){
+		for ( auto it = resident.begin(); it != resident.end(); ++it ){
+			glDeleteBuffers(1, &it->second.chunk.vbo);
+		}
+		delete overview;
+	}
+
+	/**
+	 * Get the vertex buffer for a chunk, building it if it is not resident.
+	 */
+	const Chunk& acquire(size_t cx, size_t cy) const {
+		const size_t key = cy * chunks_x + cx;
+
+		auto it = resident.find(key);
+		if ( it != resident.end() ){
+			lru.splice(lru.begin(), lru, it->second.lru);
+			return it->second.chunk;
+		}
+
+		/* recycle the buffer of the least recently drawn chunk */
+		Chunk chunk;
+		if ( resident.size() >= max_resident ){
+			auto victim = resident.find(lru.back());
+			chunk = victim->second.chunk;
+			resident.erase(victim);
+			lru.pop_back();
+		} else {
+			glGenBuffers(1, &chunk.vbo);
+		}
+
+		build(cx, cy);
+		chunk.num_vertices = buffer.size();
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * buffer.size(), buffer.data(), GL_STATIC_DRAW);
+
+		lru.push_front(key);
+		Resident& r = resident[key];
+		r.chunk = chunk;
+		r.lru = lru.begin();
+		return r.chunk;
+	}
+
+	bool is_resident(size_t cx, size_t cy) const {
+		return resident.count(cy * chunks_x + cx) > 0;
+	}
+
+	Texture texture;
+	size_t chunks_x;
+	size_t chunks_y;
+	SDLRenderTarget* overview;
+
+private:
+	struct Resident {
+		Chunk chunk;
+		std::list<size_t>::iterator lru;
+	};
+
+	/**
+	 * Fill the scratch buffer with the vertices of a chunk (four per tile).
+	 */
+	void build(size_t cx, size_t cy) const {
+		const size_t cells = std::min(size(), (size_t)(end() - begin()));
+		const size_t x0 = cx * chunk_size;
+		const size_t y0 = cy * chunk_size;
+		const size_t x1 = std::min(x0 + chunk_size, map_width());
+		const size_t y1 = std::min(y0 + chunk_size, map_height());
+
+		buffer.clear();
+		for ( size_t y = y0; y < y1; y++ ){
+			for ( size_t x = x0; x < x1; x++ ){
+				const size_t i = y * map_width() + x;
+				if ( i >= cells ) return;
+
+				const float* uv = this->uv((*this)[i].index());
+				const float px0 = (float)((x  ) * tile_width());
+				const float py0 = (float)((y  ) * tile_height());
+				const float px1 = (float)((x+1) * tile_width());
+				const float py1 = (float)((y+1) * tile_height());
+
+				/* z is unused */
+				const vertex v[4] = {
+					{px0, py0, 0.0f, uv[0], uv[1]},
+					{px1, py0, 0.0f, uv[2], uv[3]},
+					{px1, py1, 0.0f, uv[4], uv[5]},
+					{px0, py1, 0.0f, uv[6], uv[7]},
+				};
+				buffer.insert(buffer.end(), v, v + 4);
+			}
+		}
+	}
+
+	/**
+	 * Main thread part of loading, after the tileset has been decoded.
+	 */
+	void finish_loading(){
+		set_dimensions(texture.width, texture.height);
+
+		fprintf(stderr, "  rendering overview (%zux%zu chunks)\n", chunks_x, chunks_y);
+		render_overview();
+	}
+
+	void render_overview(){
+		const size_t w = map_width()  * tile_width();
+		const size_t h = map_height() * tile_height();
+		const float scale = std::min(1.0f, (float)overview_max / (float)std::max(std::max(w, h), (size_t)1));
+		const Vector2i dim(
+			std::max(1, (int)(w * scale)),
+			std::max(1, (int)(h * scale))
+		);
+
+		overview = new SDLRenderTarget(dim, false);
+		overview->bind();
+		glClearColor(0, 0, 0, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glPushMatrix();
+		glLoadIdentity();
+		glScalef(scale, scale, 1.0f);
+		glBindTexture(GL_TEXTURE_2D, texture.get());
+		glColor4f(1,1,1,1);
+
+		GLuint scratch;
+		glGenBuffers(1, &scratch);
+		glBindBuffer(GL_ARRAY_BUFFER, scratch);
+		for ( size_t cy = 0; cy < chunks_y; cy++ ){
+			for ( size_t cx = 0; cx < chunks_x; cx++ ){
+				build(cx, cy);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * buffer.size(), NULL, GL_STREAM_DRAW); /* orphan */
+				glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertex) * buffer.size(), buffer.data());
+				glVertexPointer(3, GL_FLOAT, sizeof(vertex), (const GLvoid*)offsetof(vertex, x));
+				glTexCoordPointer(2, GL_FLOAT, sizeof(vertex), (const GLvoid*)offsetof(vertex, s));
+				glDrawArrays(GL_QUADS, 0, buffer.size());
+			}
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDeleteBuffers(1, &scratch);
+
+		glPopMatrix();
+		overview->unbind();
+
+		/* smoother when scaled to fit the window */
+		glBindTexture(GL_TEXTURE_2D, overview->color);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+
+	mutable std::unordered_map<size_t, Resident> resident;
+	mutable std::list<size_t> lru;       /* most recently drawn first */
+	mutable std::vector<vertex> buffer;  /* scratch */
+};
+
 class BitmapFont: public Font {
 public:
 	BitmapFont(const std::string& filename){
@@ -372,26 +776,17 @@ public:
 		/* read bitmaps */
 		const size_t pixel_size = header.bpp / 8;
 		const size_t bytes = header.image_width * header.image_height * pixel_size;
-		char* data = (char*)malloc(bytes);
-		if ( fread(data, 1, bytes, fp) != bytes ){
+		std::vector<char> data(bytes);
+		if ( fread(data.data(), 1, bytes, fp) != bytes ){
 			fprintf(stderr, "Font `%s' is not a valid font: file truncated\n", real_filename);
 			abort();
 		}
+		fclose(fp);
 
-		/* upload texture */
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, header.image_width, header.image_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-		free(data);
-	}
-
-	virtual ~BitmapFont(){
-		glDeleteTextures(1, &texture);
+		/* fonts may be created on loader threads, upload is left to the main thread */
+		texture.clamp = true;
+		texture.set_pixels(header.image_width, header.image_height, data);
+		upload_later(&texture);
 	}
 
 	virtual void  printf(int x, int y, const Color& color, const char* fmt, ...) const {
@@ -465,7 +860,7 @@ public:
 		glLoadIdentity();
 		glTranslatef(x, y, 0);
 		glColor4fv(color.value);
-		glBindTexture(GL_TEXTURE_2D, texture);
+		glBindTexture(GL_TEXTURE_2D, texture.get());
 		glVertexPointer  (3, GL_FLOAT, sizeof(float)*5, &v[0].x);
 		glTexCoordPointer(2, GL_FLOAT, sizeof(float)*5, &v[0].s);
 		glDrawArrays(GL_QUADS, 0, num_vertices);
@@ -478,7 +873,7 @@ public:
 	}
 
 private:
-	GLuint texture;
+	Texture texture;
 	unsigned char base;
 	unsigned char pitch;
 	Vector2i cell;
@@ -488,6 +883,11 @@ private:
 
 class SDLBackend: public Backend {
 public:
+	SDLBackend()
+		: batch_vbo(0) {
+
+	}
+
 	virtual ~SDLBackend(){
 
 	}
@@ -500,6 +900,9 @@ public:
 			exit(1);
 		}
 
+		/* image loaders are initialized up front as textures are decoded on loader threads */
+		IMG_Init(IMG_INIT_JPG|IMG_INIT_PNG);
+
 		SDL_GL_SetAttribute(SDL_GL_SWAP_CONTROL, 1);
 		SDL_SetVideoMode(size.x, size.y, 0, video_flags);
 		SDL_EnableKeyRepeat(0, 0);
@@ -524,6 +927,9 @@ public:
 
 		glEnableClientState(GL_VERTEX_ARRAY);
 		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+		/* streamed vertex buffer for batched sprites, refilled every frame */
+		glGenBuffers(1, &batch_vbo);
 	}
 
 	virtual void poll(bool& running){
@@ -587,6 +993,8 @@ public:
 	}
 
 	virtual void cleanup(){
+		glDeleteBuffers(1, &batch_vbo);
+		IMG_Quit();
 		SDL_Quit();
 	}
 
@@ -669,12 +1077,22 @@ public:
 	virtual void render_sprite(const Vector2i pos, const Sprite* in_sprite, const Color& color) const {
 		const SDLSprite* sprite = static_cast<const SDLSprite*>(in_sprite);
 
+		/* unit quad with the texture coordinates of the sprite in its atlas page */
+		const Vector2f uv0 = sprite->uv_min();
+		const Vector2f uv1 = sprite->uv_max();
+		const float v[][5] = { /* x,y,z,u,v */
+			{0, 0, 0, uv0.x, uv0.y},
+			{1, 0, 0, uv1.x, uv0.y},
+			{1, 1, 0, uv1.x, uv1.y},
+			{0, 1, 0, uv0.x, uv1.y},
+		};
+
 		glPushMatrix();
 		glLoadIdentity();
 		glTranslatef(pos.x, pos.y, 0.0f);
-		glBindTexture(GL_TEXTURE_2D, sprite->texture);
-		glVertexPointer(3, GL_FLOAT, sizeof(float)*5, vertices);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(float)*5, &vertices[0][3]);
+		glBindTexture(GL_TEXTURE_2D, sprite->texture_id());
+		glVertexPointer(3, GL_FLOAT, sizeof(float)*5, v);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(float)*5, &v[0][3]);
 		glColor4fv(color.value);
 		glScalef(sprite->scale().x, sprite->scale().y,	1.0f);
 		glDrawElements(GL_QUADS, 4, GL_UNSIGNED_INT, indices);
@@ -684,17 +1102,45 @@ public:
 	virtual void render_tilemap(const Tilemap& in, const Vector2f& camera) const {
 		const SDLTilemap* tilemap = static_cast<const SDLTilemap*>(&in);
 
+		/* find the chunks intersecting the view */
+		const Vector2i view = SDLRenderTarget::current ? SDLRenderTarget::current->size : size;
+		const float chunk_w = (float)(SDLTilemap::chunk_size * tilemap->tile_width());
+		const float chunk_h = (float)(SDLTilemap::chunk_size * tilemap->tile_height());
+		const int cx0 = std::max(0, (int)floorf(camera.x / chunk_w));
+		const int cy0 = std::max(0, (int)floorf(camera.y / chunk_h));
+		const int cx1 = std::min((int)tilemap->chunks_x, (int)ceilf((camera.x + view.x) / chunk_w));
+		const int cy1 = std::min((int)tilemap->chunks_y, (int)ceilf((camera.y + view.y) / chunk_h));
+
 		glPushMatrix();
 
 		/* camera */
 		glTranslatef(-camera.x, -camera.y, 0.0f);
 
-		glBindTexture(GL_TEXTURE_2D, tilemap->texture);
+		glBindTexture(GL_TEXTURE_2D, tilemap->texture.get());
 		glColor4f(1,1,1,1);
-		glVertexPointer(3, GL_FLOAT, sizeof(vertex), &tilemap->vertices[0].x);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(vertex), &tilemap->vertices[0].s);
-		glDrawElements(GL_QUADS, 4*tilemap->size(), GL_UNSIGNED_INT, tilemap->indices);
 
+		for ( int cy = cy0; cy < cy1; cy++ ){
+			for ( int cx = cx0; cx < cx1; cx++ ){
+				const SDLTilemap::Chunk& chunk = tilemap->acquire(cx, cy);
+				glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+				glVertexPointer(3, GL_FLOAT, sizeof(vertex), (const GLvoid*)offsetof(vertex, x));
+				glTexCoordPointer(2, GL_FLOAT, sizeof(vertex), (const GLvoid*)offsetof(vertex, s));
+				glDrawArrays(GL_QUADS, 0, chunk.num_vertices);
+			}
+		}
+
+		/* build a few of the chunks just outside the view so panning does not stall */
+		size_t prefetched = 0;
+		for ( int cy = std::max(cy0 - 1, 0); cy < std::min(cy1 + 1, (int)tilemap->chunks_y); cy++ ){
+			for ( int cx = std::max(cx0 - 1, 0); cx < std::min(cx1 + 1, (int)tilemap->chunks_x); cx++ ){
+				if ( prefetched == SDLTilemap::max_prefetch ) break;
+				if ( tilemap->is_resident(cx, cy) ) continue;
+				tilemap->acquire(cx, cy);
+				prefetched++;
+			}
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glPopMatrix();
 		int err;
 		if ( (err=glGetError()) != GL_NO_ERROR ){
@@ -703,6 +1149,24 @@ public:
 		}
 	}
 
+	virtual void render_overview(const Tilemap& in, const Vector2i& pos, const Vector2i& dim) const {
+		const SDLTilemap* tilemap = static_cast<const SDLTilemap*>(&in);
+
+		glPushMatrix();
+		glLoadIdentity();
+		glColor4f(1,1,1,1);
+		glBindTexture(GL_TEXTURE_2D, tilemap->overview->color);
+		glVertexPointer(3, GL_FLOAT, sizeof(float)*5, vertices);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(float)*5, &vertices[0][3]);
+
+		/* render targets are stored upside down */
+		glTranslatef(pos.x, pos.y + dim.y, 0.0f);
+		glScalef(dim.x, -dim.y, 1.0f);
+		glDrawElements(GL_QUADS, 4, GL_UNSIGNED_INT, indices);
+
+		glPopMatrix();
+	}
+
 	virtual void render_marker(const Vector2f& pos, const Vector2f& camera, const bool v[]) const {
 		glPushMatrix();
 
@@ -775,8 +1239,8 @@ public:
 		}
 	}
 
-	virtual void render_region(const Entity* ent, const Vector2f& camera, float color[3]) const {
-		const SDLSprite* sprite = static_cast<const SDLSprite*>(ent->sprite());
+	virtual void render_region(const Snapshot::Entity* ent, const Vector2f& camera, float color[3]) const {
+		const SDLSprite* sprite = static_cast<const SDLSprite*>(ent->sprite);
 
 		glPushMatrix();
 
@@ -784,7 +1248,7 @@ public:
 		glTranslatef(-camera.x, -camera.y, 0.0f);
 
 		/* position */
-		glTranslatef(ent->world_pos().x, ent->world_pos().y, 0.0f);
+		glTranslatef(ent->pos.x, ent->pos.y, 0.0f);
 
 		/* tile scale */
 		glScalef(sprite->scale().x, sprite->scale().y + sprite->offset().y, 1.0f);
@@ -811,68 +1275,34 @@ public:
 		}
 	}
 
-	virtual void render_entities(std::vector<Entity*>& entities, const Vector2f& camera) const {
-		glPushMatrix();
-		glPushAttrib(GL_ENABLE_BIT);
+	virtual void render_entities(const std::vector<Snapshot::Entity>& entities, const Vector2f& camera) const {
+		batch.clear();
 
-		/* camera */
-		glTranslatef(-camera.x, -camera.y, 0.0f);
-
-		glVertexPointer(3, GL_FLOAT, sizeof(float)*5, vertices);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(float)*5, &vertices[0][3]);
-		glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+		/* healthbars use the white area of the atlas so they batch with the sprites */
+		const Atlas::Region& white = atlas.white();
 
+		/* entities arrive sorted by depth, each sprite is followed by its healthbar */
 		for ( auto it = entities.begin(); it != entities.end(); ++it ){
-			const Entity* ent = *it;
-			const SDLSprite* sprite = static_cast<const SDLSprite*>(ent->sprite());
+			const SDLSprite* sprite = static_cast<const SDLSprite*>(it->sprite);
 			assert(sprite);
 
-			glEnable(GL_TEXTURE_2D);
-			glColor4f(1,1,1,1);
-			glBindTexture(GL_TEXTURE_2D, sprite->texture);
-
-			glPushMatrix();
-			glTranslatef(
-				ent->world_pos().x + Game::tile_width()  * sprite->offset().x,
-				ent->world_pos().y + Game::tile_height() * sprite->offset().y,
-				0.0f);
-
-			/* entity scale */
-			glPushMatrix();
-			glScalef(sprite->scale().x, sprite->scale().y, 1.0f);
-
-			glDrawElements(GL_QUADS, 4, GL_UNSIGNED_INT, indices);
-
-			glPopMatrix(); /* revert scale */
+			const Vector2f pos(
+				it->pos.x + Game::tile_width()  * sprite->offset().x,
+				it->pos.y + Game::tile_height() * sprite->offset().y);
+			batch.add(sprite->texture_id(), pos, sprite->scale(), Color::white, sprite->uv_min(), sprite->uv_max());
 
-			/* Render healthbar */
-			const float s = ent->current_hp() / ent->max_hp();
+			const float s = it->hp;
 			if ( s < 1.0f ){
 				const float w = sprite->scale().x * s;
-				glDisable(GL_TEXTURE_2D);
-				glColor4f(1.0f - s, s, 0.0f, 1.0f);
-				glBegin(GL_QUADS);
-				glVertex2f(0.0f, -10.0f);
-				glVertex2f(w,    -10.0f);
-				glVertex2f(w,    - 3.0f);
-				glVertex2f(0.0f, - 3.0f);
-				glEnd();
+				batch.add(white.page, pos + Vector2f(0.0f, -10.0f), Vector2f(w, 7.0f), Color::rgba(1.0f - s, s, 0.0f, 1.0f), white.uv0, white.uv1);
 			}
-
-			glPopMatrix();
 		}
 
-		glPopAttrib();
-		glPopMatrix();
-
-		int err;
-		if ( (err=glGetError()) != GL_NO_ERROR ){
-			fprintf(stderr, "OpenGL error: %s\n", gluErrorString(err));
-			abort();
-		}
+		batch.build();
+		render_batch(camera);
 	}
 
-	virtual void render_projectiles(std::vector<Projectile*>& projectiles, const Vector2f& camera) const {
+	virtual void render_projectiles(const std::vector<Snapshot::Projectile>& projectiles, const Vector2f& camera) const {
 		glPushMatrix();
 		glPushAttrib(GL_ENABLE_BIT);
 		glLineWidth(1.0f);
@@ -882,13 +1312,10 @@ public:
 
 		glColor4f(1,1,1,1);
 		glDisable(GL_TEXTURE_2D);
-		std::for_each(projectiles.begin(), projectiles.end(), [](const Projectile* proj){
-			Vector2f src, dst;
-			proj->get_points(&src, &dst);
-
+		std::for_each(projectiles.begin(), projectiles.end(), [](const Snapshot::Projectile& proj){
 			glBegin(GL_LINES);
-			glVertex2f(src.x, src.y);
-			glVertex2f(dst.x, dst.y);
+			glVertex2f(proj.pos[0].x, proj.pos[0].y);
+			glVertex2f(proj.pos[1].x, proj.pos[1].y);
 			glEnd();
 		});
 
@@ -933,6 +1360,54 @@ public:
 	}
 
 private:
+	/**
+	 * Upload the batch to the stream buffer and draw one run at a time.
+	 */
+	void render_batch(const Vector2f& camera) const {
+		const std::vector<SpriteBatch::Vertex>& v = batch.vertices();
+		if ( v.empty() ) return;
+
+		typedef SpriteBatch::Vertex V;
+		glBindBuffer(GL_ARRAY_BUFFER, batch_vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(V) * v.size(), NULL, GL_STREAM_DRAW); /* orphan last frame */
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(V) * v.size(), &v[0]);
+
+		glPushMatrix();
+		glPushAttrib(GL_ENABLE_BIT);
+		glEnableClientState(GL_COLOR_ARRAY);
+
+		/* camera */
+		glTranslatef(-camera.x, -camera.y, 0.0f);
+
+		glVertexPointer  (2, GL_FLOAT,         sizeof(V), (const GLvoid*)offsetof(V, x));
+		glTexCoordPointer(2, GL_FLOAT,         sizeof(V), (const GLvoid*)offsetof(V, s));
+		glColorPointer   (4, GL_UNSIGNED_BYTE, sizeof(V), (const GLvoid*)offsetof(V, color));
+
+		const std::vector<SpriteBatch::Run>& runs = batch.runs();
+		for ( auto it = runs.begin(); it != runs.end(); ++it ){
+			if ( it->texture ){
+				glEnable(GL_TEXTURE_2D);
+			} else {
+				glDisable(GL_TEXTURE_2D);
+			}
+			glBindTexture(GL_TEXTURE_2D, it->texture);
+			glDrawArrays(GL_QUADS, it->first, it->count);
+		}
+
+		glDisableClientState(GL_COLOR_ARRAY);
+		glPopAttrib();
+		glPopMatrix();
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		int err;
+		if ( (err=glGetError()) != GL_NO_ERROR ){
+			fprintf(stderr, "OpenGL error: %s\n", gluErrorString(err));
+			abort();
+		}
+	}
+
+	GLuint batch_vbo;
+	mutable SpriteBatch batch;
 	bool pressed[SDLK_LAST];
 	std::function<void()> actions[SDLK_LAST];
 };
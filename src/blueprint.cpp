@@ -3,32 +3,118 @@
 #endif
 
 #include "blueprint.hpp"
+#include "blueprint_format.hpp"
 #include "common.hpp"
 #include "entity.hpp"
 #include "game.hpp"
+#include "hash.hpp"
+#include "keyword.hpp"
 #include "sprite.hpp"
+#include <stdint.h>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <thread>
 #include <yaml.h>
 
-Blueprint::Blueprint(){
+#ifdef WIN32
+#include <process.h>
+#define getpid _getpid
+#define snprintf _snprintf
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * Revision of how parse_leveldata turns YAML values into stats. Bump it when
+ * a conversion changes (e.g. how slow is derived from the percentage) so old
+ * caches are rebuilt.
+ */
+static const uint32_t parser_revision = 1;
+
+/**
+ * Stats as stored in the cache. Every stat is listed with its enum value so
+ * reordering, adding or removing stats changes layout_hash().
+ */
+static const struct {
+	Blueprint::Stat stat;
+	const char* name;
+} stat_layout[] = {
+	{Blueprint::SPLASH,          "splash"},
+	{Blueprint::DAMAGE,          "damage"},
+	{Blueprint::ROF,             "rof"},
+	{Blueprint::RANGE,           "range"},
+	{Blueprint::SLOW,            "slow"},
+	{Blueprint::SLOW_DURATION,   "slow_duration"},
+	{Blueprint::POISON,          "poison"},
+	{Blueprint::POISON_DURATION, "poison_duration"},
+	{Blueprint::SPEED,           "speed"},
+	{Blueprint::ARMOR,           "armor"},
+	{Blueprint::HP,              "hp"},
+};
+
+static_assert(sizeof(stat_layout) / sizeof(stat_layout[0]) == Blueprint::STAT_LAST, "stat missing from stat_layout");
+
+/**
+ * Fingerprint of the stat layout and parser, caches with another fingerprint
+ * are rebuilt.
+ */
+static uint64_t layout_hash(){
+	Fnv1a hash;
+	hash.add(parser_revision);
+	for ( auto it = std::begin(stat_layout); it != std::end(stat_layout); ++it ){
+		hash.add((uint32_t)it->stat);
+		hash.add(it->name, strlen(it->name) + 1);
+	}
+	return hash.value;
+}
+
+Blueprint::Blueprint()
+	: table(NULL)
+	, stride(0) {
 
 }
 
 const Blueprint* Blueprint::from_filename(const std::string& filename){
-	auto bp = new Blueprint;
+	const std::string real_filename = real_path(filename.c_str());
+	const std::string cache_filename = real_filename + ".cache";
 
-	const char* real_filename = real_path(filename.c_str());
-	FILE* fp = fopen(real_filename, "rb");
-	if ( !fp ){
+	std::vector<char> source;
+	FILE* fp = fopen(real_filename.c_str(), "rb");
+	if ( !fp || !read_all(fp, source) ){
 		fprintf(stderr, "Failed to load blueprint `%s'\n", filename.c_str());
 		exit(1);
 	}
+	fclose(fp);
 
 	fprintf(stderr, "Loading blueprint `%s'\n", filename.c_str());
 
+	Fnv1a hash;
+	hash.add(source.data(), source.size());
+
+	std::vector<level> levels;
+	if ( !load_cache(cache_filename, hash.value, levels) ){
+		parse(source, levels);
+		save_cache(cache_filename, hash.value, levels);
+	}
+
+	auto bp = new Blueprint;
+	bp->set_levels(levels);
+	fprintf(stderr, "  * %zd levels loaded\n", bp->num_levels());
+
+	return bp;
+}
+
+/**
+ * Parse YAML source into resolved levels, each level starts as a copy of the
+ * previous one.
+ */
+void Blueprint::parse(const std::vector<char>& source, std::vector<level>& levels){
 	yaml_parser_t parser;
 	yaml_parser_initialize(&parser);
 
-	yaml_parser_set_input_file(&parser, fp);
+	yaml_parser_set_input_string(&parser, reinterpret_cast<const unsigned char*>(source.data()), source.size());
 
 	yaml_event_t event;
 	yaml_parser_parse(&parser, &event) || yaml_error(&parser);
@@ -44,24 +130,23 @@ const Blueprint* Blueprint::from_filename(const std::string& filename){
 	}
 
 	/* defaults */
-	struct level current = {
-		/* yey, not even c++0x supports designated initializers... =( */
-		/* .sprite = */ NULL,
-		/* .icon   = */ NULL,
-		/* .name   = */ std::string("unnamed tower"),
-		/* .cost   = */ 100,
-		/* .splash = */ 0.0f,
-		/* .damage = */ 1.0f,
-		/* .rof    = */ 1.0f,
-		/* .range  = */ 100.0f,
-		/* .slow   = */ 0.0f,
-		/* .slow_d = */ 0.0f,
-		/* .poison = */ 0.0f,
-		/* .poison_d= */ 0.0f,
-		/* .speed  = */ 0.0f,
-		/* .armor  = */ 0.0f,
-		/* .amount = */ 10,
-	};
+	struct level current;
+	current.sprite = NULL;
+	current.icon = NULL;
+	current.name = "unnamed tower";
+	current.cost = 100;
+	current.amount = 0;
+	current.stat[SPLASH] = 0.0f;
+	current.stat[DAMAGE] = 1.0f;
+	current.stat[ROF] = 1.0f;
+	current.stat[RANGE] = 100.0f;
+	current.stat[SLOW] = 0.0f;
+	current.stat[SLOW_DURATION] = 0.0f;
+	current.stat[POISON] = 0.0f;
+	current.stat[POISON_DURATION] = 0.0f;
+	current.stat[SPEED] = 0.0f;
+	current.stat[ARMOR] = 0.0f;
+	current.stat[HP] = 10.0f;
 
 	bool done = false;
 	do {
@@ -80,15 +165,227 @@ const Blueprint* Blueprint::from_filename(const std::string& filename){
 		}
 
 		parse_leveldata(&current, &parser);
-		bp->data.push_back(current);
+		levels.push_back(current);
 	} while(!done);
 
-	fprintf(stderr, "  * %zd levels loaded\n", bp->data.size());
-
 	yaml_parser_delete(&parser);
+}
+
+/**
+ * Read resolved levels from the cache (see blueprint_format.hpp).
+ * @return false if the cache is missing, outdated or invalid.
+ */
+bool Blueprint::load_cache(const std::string& filename, uint64_t source_hash, std::vector<level>& levels){
+	using namespace BlueprintFormat;
+
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if ( !fp ) return false;
+
+	std::vector<char> data;
+	const bool ok = read_all(fp, data);
 	fclose(fp);
 
-	return bp;
+	const char* reason = NULL;
+	const Header* header = reinterpret_cast<const Header*>(data.data());
+	const auto inside = [&data](uint64_t offset, uint64_t size){
+		return offset <= data.size() && size <= data.size() - offset;
+	};
+
+	if ( !ok || data.size() < sizeof(Header) || memcmp(header->magic, magic, sizeof(magic)) != 0 ){
+		reason = "not a blueprint cache";
+	} else if ( header->version != version || header->byte_order != byte_order || header->num_stats != STAT_LAST ||
+	            header->layout_hash != layout_hash() ){
+		reason = "written by another version";
+	} else if ( header->source_hash != source_hash ){
+		reason = "source changed";
+	} else if ( !inside(header->sprites_offset, sizeof(SpriteRecord) * (uint64_t)header->num_sprites) ||
+	            !inside(header->levels_offset, sizeof(LevelRecord) * (uint64_t)header->num_levels) ||
+	            !inside(header->stats_offset, sizeof(float) * (uint64_t)header->num_levels * STAT_LAST) ||
+	            !inside(header->strings_offset, header->strings_size) ){
+		reason = "section out of bounds";
+	} else if ( (header->sprites_offset | header->levels_offset | header->stats_offset) % 8 ){
+		reason = "unaligned section";
+	} else if ( header->strings_size == 0 || data[header->strings_offset + header->strings_size - 1] != 0 ){
+		reason = "unterminated string table";
+	}
+
+	if ( reason ){
+		fprintf(stderr, "  * rebuilding cache (%s)\n", reason);
+		return false;
+	}
+
+	const char* strings = data.data() + header->strings_offset;
+	const uint64_t strings_size = header->strings_size;
+	const auto str = [strings, strings_size](uint32_t offset) -> std::string {
+		return offset < strings_size ? std::string(strings + offset) : std::string();
+	};
+
+	std::vector<Sprite*> sprites(header->num_sprites + 1, NULL);
+	const SpriteRecord* sprite = reinterpret_cast<const SpriteRecord*>(data.data() + header->sprites_offset);
+	for ( uint32_t i = 0; i < header->num_sprites; i++, sprite++ ){
+		const Vector2f offset(sprite->offset[0], sprite->offset[1]);
+		const Vector2f tile_scale(sprite->tile_scale[0], sprite->tile_scale[1]);
+		sprites[i+1] = Sprite::from_source(str(sprite->texture), offset, tile_scale);
+	}
+
+	const LevelRecord* record = reinterpret_cast<const LevelRecord*>(data.data() + header->levels_offset);
+	const float* stats = reinterpret_cast<const float*>(data.data() + header->stats_offset);
+	const uint32_t n = header->num_levels;
+	levels.resize(n);
+	for ( uint32_t i = 0; i < n; i++, record++ ){
+		level& cur = levels[i];
+		cur.sprite = record->sprite <= header->num_sprites ? sprites[record->sprite] : NULL;
+		cur.icon = record->icon <= header->num_sprites ? sprites[record->icon] : NULL;
+		cur.name = str(record->name);
+		cur.cost = record->cost;
+		cur.amount = record->amount;
+		for ( int s = 0; s < STAT_LAST; s++ ){
+			cur.stat[s] = stats[s * n + i];
+		}
+	}
+
+	fprintf(stderr, "  * using cache\n");
+	return true;
+}
+
+/**
+ * Write resolved levels to the cache, sprites shared between levels are
+ * stored once. Failing to write is not an error, the YAML is parsed again
+ * next time.
+ */
+void Blueprint::save_cache(const std::string& filename, uint64_t source_hash, const std::vector<level>& levels){
+	using namespace BlueprintFormat;
+
+	/* offset 0 is the empty string */
+	std::vector<char> strings(1, 0);
+	auto add_string = [&strings](const std::string& str) -> uint32_t {
+		if ( str.empty() ) return 0;
+		const uint32_t offset = strings.size();
+		strings.insert(strings.end(), str.begin(), str.end());
+		strings.push_back(0);
+		return offset;
+	};
+	auto align = [](uint64_t offset) -> uint64_t {
+		return (offset + 7) & ~(uint64_t)7;
+	};
+
+	std::map<const Sprite*, uint32_t> sprite_index;
+	std::vector<SpriteRecord> sprites;
+	auto add_sprite = [&](const Sprite* sprite) -> uint32_t {
+		if ( !sprite ) return 0;
+		auto it = sprite_index.find(sprite);
+		if ( it != sprite_index.end() ) return it->second;
+
+		SpriteRecord r;
+		memset(&r, 0, sizeof(SpriteRecord));
+		r.texture = add_string(sprite->texture_name());
+		r.offset[0] = sprite->offset().x;
+		r.offset[1] = sprite->offset().y;
+		r.tile_scale[0] = sprite->tile_scale().x;
+		r.tile_scale[1] = sprite->tile_scale().y;
+		sprites.push_back(r);
+		return sprite_index[sprite] = sprites.size();
+	};
+
+	const size_t n = levels.size();
+	std::vector<LevelRecord> records(n);
+	std::vector<float> stats(STAT_LAST * n);
+	for ( size_t i = 0; i < n; i++ ){
+		LevelRecord& r = records[i];
+		memset(&r, 0, sizeof(LevelRecord));
+		r.name = add_string(levels[i].name);
+		r.sprite = add_sprite(levels[i].sprite);
+		r.icon = add_sprite(levels[i].icon);
+		r.cost = levels[i].cost;
+		r.amount = levels[i].amount;
+		for ( int s = 0; s < STAT_LAST; s++ ){
+			stats[s * n + i] = levels[i].stat[s];
+		}
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version        = version;
+	header.byte_order     = byte_order;
+	header.source_hash    = source_hash;
+	header.layout_hash    = layout_hash();
+	header.num_sprites    = sprites.size();
+	header.num_levels     = n;
+	header.num_stats      = STAT_LAST;
+	header.sprites_offset = align(sizeof(Header));
+	header.levels_offset  = align(header.sprites_offset + sizeof(SpriteRecord) * sprites.size());
+	header.stats_offset   = align(header.levels_offset + sizeof(LevelRecord) * n);
+	header.strings_offset = align(header.stats_offset + sizeof(float) * stats.size());
+	header.strings_size   = strings.size();
+
+	std::vector<char> data(header.strings_offset + header.strings_size, 0);
+	memcpy(&data[0], &header, sizeof(Header));
+	if ( !sprites.empty() ) memcpy(&data[header.sprites_offset], &sprites[0], sizeof(SpriteRecord) * sprites.size());
+	if ( n > 0 ){
+		memcpy(&data[header.levels_offset], &records[0], sizeof(LevelRecord) * n);
+		memcpy(&data[header.stats_offset], &stats[0], sizeof(float) * stats.size());
+	}
+	memcpy(&data[header.strings_offset], &strings[0], strings.size());
+
+	/* written to a file unique to this process and thread, then renamed, so
+	 * concurrent writers never see or clobber each other's partial cache */
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%d.%zx.tmp", (int)getpid(), std::hash<std::thread::id>()(std::this_thread::get_id()));
+	const std::string tmp = filename + suffix;
+	FILE* fp = fopen(tmp.c_str(), "wb");
+	if ( !fp ){
+		fprintf(stderr, "  * cache `%s' not written: %s\n", filename.c_str(), strerror(errno));
+		return;
+	}
+
+	const bool ok = fwrite(&data[0], 1, data.size(), fp) == data.size();
+	if ( fclose(fp) != 0 || !ok || rename(tmp.c_str(), filename.c_str()) != 0 ){
+		fprintf(stderr, "  * cache `%s' not written: %s\n", filename.c_str(), strerror(errno));
+		remove(tmp.c_str());
+	}
+}
+
+/**
+ * Read the rest of a file.
+ */
+bool Blueprint::read_all(FILE* fp, std::vector<char>& data){
+	char buffer[4096];
+	size_t bytes;
+	while ( (bytes = fread(buffer, 1, sizeof(buffer), fp)) > 0 ){
+		data.insert(data.end(), buffer, buffer + bytes);
+	}
+	return !ferror(fp);
+}
+
+/**
+ * Split levels into the stat table and the other data.
+ */
+void Blueprint::set_levels(const std::vector<level>& levels){
+	const size_t n = levels.size();
+	const size_t per_line = cache_line / sizeof(float);
+	stride = (n + per_line - 1) / per_line * per_line;
+
+	/* vector storage is only float aligned, skip ahead to a cache line */
+	storage.assign(STAT_LAST * stride + per_line, 0.0f);
+	const uintptr_t address = (uintptr_t)storage.data();
+	const size_t skip = (cache_line - address % cache_line) % cache_line / sizeof(float);
+	float* out = storage.data() + skip;
+	table = out;
+
+	costs.resize(n);
+	amounts.resize(n);
+	info.resize(n);
+	for ( size_t i = 0; i < n; i++ ){
+		for ( int s = 0; s < STAT_LAST; s++ ){
+			out[s * stride + i] = levels[i].stat[s];
+		}
+		costs[i] = levels[i].cost;
+		amounts[i] = levels[i].amount;
+		info[i].sprite = levels[i].sprite;
+		info[i].icon = levels[i].icon;
+		info[i].name = levels[i].name;
+	}
 }
 
 void Blueprint::parse_leveldata(struct level* level, yaml_parser_t* parser){
@@ -107,39 +404,40 @@ void Blueprint::parse_leveldata(struct level* level, yaml_parser_t* parser){
 			abort();
 		}
 
-		const std::string key((const char*)event.data.scalar.value, event.data.scalar.length);
+		const ScalarView key(event);
+		const Keyword::Id id = Keyword::lookup(key);
 
 		/* sprite requires special handling */
-		if ( key == "sprite" ){
+		if ( id == Keyword::SPRITE ){
 			level->sprite = Sprite::from_yaml(parser, level->sprite);
 			continue;
 		}
 
 		yaml_parser_parse(parser, &evalue) || yaml_error(parser);
-		const char* value = (const char*)evalue.data.scalar.value;
-		const size_t len = evalue.data.scalar.length;
+		const ScalarView value(evalue);
 
 		/* Fill level with info */
-		if ( key == "level" ){
-			/* ignore */
-		} else if ( key == "name"   ){ level->name = std::string(value, len);
-		} else if ( key == "icon"   ){ level->icon = Sprite::from_filename(std::string(value, len));
-		} else if ( key == "cost"   ){ level->cost = atoi(value);
-		} else if ( key == "splash" ){ level->splash = (float)atof(value);
-		} else if ( key == "damage" ){ level->damage = (float)atof(value);
-		} else if ( key == "rof"    ){ level->rof = (float)atof(value);
-		} else if ( key == "range"  ){ level->range = (float)atof(value);
-		} else if ( key == "slow"   ){ level->slow = 1.0f - (float)atof(value) / 100.0f;
-		} else if ( key == "slow_duration" ){ level->slow_duration = (float)atof(value);
-		} else if ( key == "poison" ){ level->poison = (float)atof(value);
-		} else if ( key == "poison_duration" ){ level->poison_duration = (float)atof(value);
-		} else if ( key == "speed"  ){ level->speed = (float)atof(value);
-		} else if ( key == "armor"  ){ level->armor = (float)atof(value);
-		} else if ( key == "amount" ){ level->amount = (float)atoi(value);
-		} else if ( key == "hp" ){     level->hp = (float)atoi(value);
-		} else {
+		switch ( id ){
+		case Keyword::LEVEL: /* ignore */ break;
+		case Keyword::NAME:   level->name = value.str(); break;
+		case Keyword::ICON:   level->icon = Sprite::from_filename(value.str()); break;
+		case Keyword::COST:   level->cost = value.to_int(); break;
+		case Keyword::SPLASH: level->stat[SPLASH] = value.to_float(); break;
+		case Keyword::DAMAGE: level->stat[DAMAGE] = value.to_float(); break;
+		case Keyword::ROF:    level->stat[ROF] = value.to_float(); break;
+		case Keyword::RANGE:  level->stat[RANGE] = value.to_float(); break;
+		/* changing a conversion needs a new parser_revision */
+		case Keyword::SLOW:   level->stat[SLOW] = 1.0f - value.to_float() / 100.0f; break;
+		case Keyword::SLOW_DURATION: level->stat[SLOW_DURATION] = value.to_float(); break;
+		case Keyword::POISON: level->stat[POISON] = value.to_float(); break;
+		case Keyword::POISON_DURATION: level->stat[POISON_DURATION] = value.to_float(); break;
+		case Keyword::SPEED:  level->stat[SPEED] = value.to_float(); break;
+		case Keyword::ARMOR:  level->stat[ARMOR] = value.to_float(); break;
+		case Keyword::AMOUNT: level->amount = value.to_int(); break;
+		case Keyword::HP:     level->stat[HP] = (float)value.to_int(); break;
+		default:
 			/* warning only */
-			fprintf(stderr, "Unhandled key `%s'\n", key.c_str());
+			fprintf(stderr, "Unhandled key `%.*s'\n", (int)key.size(), key.data());
 		}
 	} while (1);
 }
@@ -1,71 +1,109 @@
 #ifndef FROBNICATOR_BLUEPRINT_H
 #define FROBNICATOR_BLUEPRINT_H
 
+#include <cstdio>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
 /**
  * A blueprint is essentially a flyweight for entities.
  * Everything that is common between each instance is held in the blueprint.
+ *
+ * Parsed levels are cached in binary form next to the YAML file and the
+ * cache is used as long as the YAML is unchanged (see blueprint_format.hpp).
+ *
+ * Gameplay stats are stored one stat after another with all levels of a stat
+ * next to each other, each stat starting on a new cache line, so hot loops
+ * reading a stat do not drag names and sprites into the cache. Use
+ * stat<Blueprint::DAMAGE>(level) etc.
  */
 class Blueprint  {
 private:
 	Blueprint();
 
 public:
+	/* stored in the blueprint cache, keep stat_layout in blueprint.cpp in sync */
+	enum Stat {
+		SPLASH,
+		DAMAGE,
+		ROF,
+		RANGE,
+		SLOW,
+		SLOW_DURATION,
+		POISON,
+		POISON_DURATION,
+		SPEED,
+		ARMOR,
+		HP,
+
+		STAT_LAST,
+	};
+
 	static const Blueprint* from_filename(const std::string& filename);
 
+	template <Stat S>
+	float stat(unsigned int level) const {
+		return table[S * stride + level];
+	}
+
 	const Sprite* sprite(unsigned int level) const {
-		return data[level].sprite;
+		return info[level].sprite;
 	}
 
 	const Sprite* icon(unsigned int level) const {
-		return data[level].icon;
+		return info[level].icon;
 	}
 
 	const std::string name(unsigned int level) const {
-		return data[level].name;
+		return info[level].name;
 	}
 
 	unsigned int amount(unsigned int level) const {
-		return data[level].amount;
+		return amounts[level];
 	}
 
 	int cost(unsigned int level) const {
-		return data[level].cost;
+		return costs[level];
 	}
 
 	size_t num_levels() const {
-		return data.size();
+		return info.size();
 	}
 
 private:
-	friend class Entity;
+	static const size_t cache_line = 64;
 
+	/* level as read from file */
 	struct level {
 		Sprite* sprite;
 		Sprite* icon;
 		std::string name;
-
-		/* gameplay stats */
 		int cost;
-		float splash;
-		float damage;
-		float rof;
-		float range;
-		float slow;
-		float slow_duration;
-		float poison;
-		float poison_duration;
-		float speed;
-		float armor;
-		float hp;
 		unsigned int amount;
+		float stat[STAT_LAST];
+	};
+
+	/* data not used by gameplay */
+	struct Info {
+		Sprite* sprite;
+		Sprite* icon;
+		std::string name;
 	};
 
+	static void parse(const std::vector<char>& source, std::vector<level>& levels);
 	static void parse_leveldata(struct level* level, yaml_parser_t* parser);
+	static bool load_cache(const std::string& filename, uint64_t source_hash, std::vector<level>& levels);
+	static void save_cache(const std::string& filename, uint64_t source_hash, const std::vector<level>& levels);
+	static bool read_all(FILE* fp, std::vector<char>& data);
+	void set_levels(const std::vector<level>& levels);
 
-	std::vector<level> data;
+	const float* table;         /* STAT_LAST rows of stride floats, points into storage */
+	size_t stride;              /* floats per row, number of levels rounded up to a cache line */
+	std::vector<float> storage; /* table with room for alignment */
+	std::vector<int> costs;
+	std::vector<unsigned int> amounts;
+	std::vector<Info> info;
 };
 
 #endif /* FROBNICATOR_BLUEPRINT_H */
@@ -0,0 +1,62 @@
+#ifndef FROBNICATOR_BLUEPRINT_FORMAT_H
+#define FROBNICATOR_BLUEPRINT_FORMAT_H
+
+#include <stdint.h>
+
+/**
+ * On-disk layout of the blueprint cache, written next to the YAML source
+ * (e.g. arrowtower.yaml.cache). Levels are stored fully resolved, i.e. with
+ * the values inherited from previous levels already applied, and the cache
+ * is only used if source_hash matches the current YAML and layout_hash
+ * matches the stat layout and parser revision of this build. Sections are aligned
+ * to 8 bytes and stored in host byte order.
+ *
+ *   Header
+ *   sprites   SpriteRecord[num_sprites]
+ *   levels    LevelRecord[num_levels]
+ *   stats     float[num_stats][num_levels]    (Blueprint::Stat order)
+ *   strings   NUL-terminated strings referenced by offset into the section
+ */
+namespace BlueprintFormat {
+	static const char magic[8] = {'F', 'R', 'O', 'B', 'B', 'L', 'U', 'E'};
+	static const uint32_t version = 2;
+	static const uint32_t byte_order = 0x01020304;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint64_t source_hash;  /* FNV-1a of the YAML source */
+		uint64_t layout_hash;  /* FNV-1a of stat layout and parser revision */
+
+		uint32_t num_sprites;
+		uint32_t num_levels;
+		uint32_t num_stats;    /* Blueprint::STAT_LAST when written */
+		uint32_t reserved;
+
+		/* section offsets from start of file */
+		uint64_t sprites_offset;
+		uint64_t levels_offset;
+		uint64_t stats_offset;
+		uint64_t strings_offset;
+		uint64_t strings_size;
+	};
+
+	struct SpriteRecord {
+		uint32_t texture;      /* string offset */
+		float offset[2];
+		float tile_scale[2];   /* zero if scaled to texture size */
+		uint32_t reserved;
+	};
+
+	struct LevelRecord {
+		uint32_t name;         /* string offset */
+		uint32_t sprite;       /* sprite index + 1, 0 if none */
+		uint32_t icon;         /* sprite index + 1, 0 if none */
+		int32_t cost;
+		uint32_t amount;
+		uint32_t reserved;
+	};
+}
+
+#endif /* FROBNICATOR_BLUEPRINT_FORMAT_H */
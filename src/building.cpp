@@ -6,66 +6,47 @@
 #include "blueprint.hpp"
 #include "creep.hpp"
 #include "game.hpp"
-#include <sstream>
-#include <time.h>
-#include <sys/time.h>
 
 Building::Building(const Vector2f& pos, const Blueprint* blueprint)
-	: Entity(generate_id(), pos, blueprint, 1)
+	: Entity(pos, blueprint, 1)
 	, last_firing(0) {
 
-	firing_delta = static_cast<uint64_t>(600.0f / rof()); /* convert shots/min to deciseconds */
+	firing_delta = static_cast<uint64_t>(Game::tickrate * 60.0f / rof()); /* convert shots/min to ticks */
+	last_firing = Game::tick() - firing_delta; /* wraps, but allows firing right away */
 }
 
-const std::string Building::generate_id(){
-	static int n = 1;
-	std::stringstream s;
-	s << "building_" << n++;
-	return s.str();
-}
-
-void Building::tick(float dt){
-	Creep* t = have_target() ? dynamic_cast<Creep*>(Game::find_entity(target)) : NULL;
+Creep* Building::update_target(){
+	Creep* t = have_target() ? Game::find_creep(target) : NULL;
 
 	if ( t ){
 		const float distance = (world_pos() - t->world_pos()).length();
 		if ( distance > range() ){
-			target = "";
+			target = Handle();
 		}
 	}
 
 	/* test if it can fire */
 	if ( t && can_fire() ){
-		fire_at(t);
-
 		/* reset target for towers with buffs */
 		if ( have_slow() || have_poison() ){
-			target = "";
+			target = Handle();
 		}
+		return t;
 	}
 
 	if ( !t ){
 		/* find closest entity within range */
-		float current = range();
-
-		for ( auto it = Game::all_creep().begin(); it != Game::all_creep().end(); ++it ){
-			Creep* creep = it->second;
-			const float distance = Vector2f::distance(world_pos(), creep->world_pos());
-
-			if ( distance < current ){
-				target = creep->id();
-				current = distance;
-			}
+		Creep* closest = Game::nearest_creep(world_pos(), range());
+		if ( closest ){
+			target = closest->handle();
 		}
 	}
+
+	return NULL;
 }
 
 bool Building::can_fire() const {
-	struct timeval t;
-	gettimeofday(&t, NULL);
-
-	uint64_t cur = t.tv_sec * 10 + t.tv_usec / 100000;
-	uint64_t delta = cur - last_firing;
+	const uint64_t delta = Game::tick() - last_firing;
 	return delta >= firing_delta;
 }
 
@@ -78,7 +59,7 @@ bool Building::have_poison() const {
 }
 
 bool Building::have_target() const {
-	return target != "";
+	return target.valid();
 }
 
 SlowBuff Building::slow_buff() const {
@@ -111,30 +92,22 @@ int Building::sell_cost() const {
 void Building::upgrade(){
 	if ( Game::transaction(upgrade_cost(), world_pos()) ){
 		level++;
-		firing_delta = static_cast<uint64_t>(600.0f / rof()); /* convert shots/min to deciseconds */
+		firing_delta = static_cast<uint64_t>(Game::tickrate * 60.0f / rof()); /* convert shots/min to ticks */
 	}
 }
 
 void Building::sell(){
 	Game::transaction(-sell_cost(), world_pos());
-	Game::remove_entity(id());
+	Game::remove_building(handle());
 }
 
 void Building::fire_at(Creep* creep){
-	/* must increase reference count because projectile callback requires the instance. */
-	inc_ref();
-
-	/* Projectile constructor has side-effects, will deallocate itself when hit. */
-	new Projectile(world_pos() + Vector2f(48.0f, -24.0f), creep, 700.0f, 25.0f, [creep, this](){
-		creep->damage(damage(), this);
-
-		if ( have_slow()   ){ creep->add_buff(slow_buff()); }
-		if ( have_poison() ){ creep->add_buff(poison_buff()); }
-
-		dec_ref();
-	});
-
-	struct timeval t;
-	gettimeofday(&t, NULL);
-	last_firing = t.tv_sec * 10 + t.tv_usec / 100000;
+	Projectile proj(world_pos() + Vector2f(48.0f, -24.0f), creep, 700.0f, 25.0f);
+	proj.source = handle();
+	proj.damage = damage();
+	if ( have_slow()   ){ proj.slow   = slow_buff(); }
+	if ( have_poison() ){ proj.poison = poison_buff(); }
+	Game::add_projectile(proj);
+
+	last_firing = Game::tick();
 }
@@ -15,7 +15,18 @@ public:
 		return new Building(world, blueprint);
 	}
 
-	virtual void tick(float dt);
+	/**
+	 * Drop targets out of range and acquire a new one. Only reads other
+	 * entities so all buildings can be updated concurrently, firing is done
+	 * afterwards by calling fire_at.
+	 * @return Creep to fire at or NULL if it cannot fire this tick.
+	 */
+	Creep* update_target();
+
+	/**
+	 * Fire projectile at creep.
+	 */
+	void fire_at(Creep* creep);
 
 	bool have_slow() const;
 	bool have_poison() const;
@@ -28,16 +39,13 @@ public:
 private:
 	Building(const Vector2f& pos, const Blueprint* blueprint);
 
-	static const std::string generate_id();
-
 	bool can_fire() const;
 	bool have_target() const;
-	void fire_at(Creep* creep);
 
 	SlowBuff slow_buff() const;
 	PoisonBuff poison_buff() const;
 
-	std::string target;
+	Handle target;
 	uint64_t firing_delta;
 	uint64_t last_firing;
 };
@@ -31,11 +31,11 @@ static const char* datapath(){
 }
 
 /**
- * Expands the path to the data-directory. Returns memory to static memory which
- * will be overwritten between successive calls.
+ * Expands the path to the data-directory. Returns memory to thread-local memory
+ * which will be overwritten between successive calls on the same thread.
  */
 const char* real_path(const char* filename){
-	static char buffer[4096];
+	static thread_local char buffer[4096];
 
 	if ( filename[0] == '/' || filename[1] == ':' ){
 		return filename;
@@ -3,87 +3,168 @@
 #endif
 
 #include "creep.hpp"
+#include "creep_store.hpp"
+#include "flowfield.hpp"
 #include "game.hpp"
+#include "thread_pool.hpp"
+#include "tilemap.hpp"
 #include "waypoint.hpp"
-#include <sstream>
-#include <iomanip>
+#include <algorithm>
+#include <cassert>
+
+static CreepStore store;
+static Arena<Creep>* wave = NULL; /* arena new creep are allocated from */
+static const size_t default_capacity = 256; /* for creep spawned outside of waves */
+
+/**
+ * Allocate new creep from arena. The previous arena is deleted right away if
+ * all its creep are gone, otherwise along with its last creep.
+ */
+static void use_arena(Arena<Creep>* arena){
+	if ( wave && wave->size() == 0 ){
+		delete wave;
+	}
+	wave = arena;
+}
+
+void Creep::begin_wave(size_t amount){
+	use_arena(new Arena<Creep>(std::max(amount, (size_t)1)));
+}
+
+Creep* Creep::spawn_at(const Vector2f& pos, const Blueprint* blueprint, unsigned int level){
+	if ( !wave || wave->full() ){
+		use_arena(new Arena<Creep>(default_capacity));
+	}
+
+	Creep* creep = wave->create(pos, blueprint, level);
+	creep->arena = wave;
+	return creep;
+}
+
+void Creep::release(Creep* creep){
+	Arena<Creep>* arena = creep->arena;
+	if ( arena->destroy(creep) && arena != wave ){
+		delete arena;
+	}
+}
+
+void Creep::end_waves(){
+	assert(!wave || wave->size() == 0);
+	delete wave;
+	wave = NULL;
+}
 
 Creep::Creep(const Vector2f& pos, const Blueprint* blueprint, unsigned int level)
-	: Entity(generate_id(), pos, blueprint, level)
+	: Entity(pos, blueprint, level)
+	, arena(NULL)
+	, region(-1)
 	, left(Game::inner()) {
+
+	state = store.add(this, pos, Entity::speed());
 }
 
-void Creep::add_buff(const SlowBuff& buf){
-	slow_buff = buf;
+Creep::~Creep(){
+	Creep* moved = store.remove(state);
+	if ( moved ){
+		moved->state = state;
+	}
 }
 
-void Creep::add_buff(const PoisonBuff& buf){
-	poison_buff = buf;
+void Creep::add_buff(const SlowBuff& buf){
+	store.set_slow(state, buf.amount, buf.duration);
 }
 
-const std::string Creep::generate_id(){
-	static int n = 1;
-	std::stringstream s;
-	s << "creep_" << std::setfill('0') << std::setw(4) << n++;
-	return s.str();
+void Creep::add_buff(const PoisonBuff& buf, const Handle& source){
+	store.set_poison(state, buf.amount, buf.duration, source);
 }
 
-std::string Creep::get_region() const {
+int Creep::get_region() const {
 	return region;
 }
 
-Creep& Creep::set_region(const std::string& name){
-	region = name;
+Creep& Creep::set_region(int id){
+	region = id;
 	return *this;
 }
 
-Creep& Creep::set_dst(const Vector2f& dst){
-	this->dst = dst;
+Creep& Creep::set_goal(const Waypoint* goal){
+	store.set_goal(state, goal ? goal->id() : -1);
 	return *this;
 }
 
-void Creep::tick(float dt){
-	const Vector2f d = (dst - pos - /* hack hack hack */ Vector2f(24,24)).normalized();
-	pos += d * speed() * dt;
+void Creep::tick_all(const Tilemap& tilemap, ThreadPool& pool, float dt){
+	/* the movement kernels aim the middle of the creep at the destination */
+	static const Vector2f half(24.0f, 24.0f);
+	static const size_t grain = 512;
+
+	/* flow fields are created the first time they are used, which must be
+	 * done before the creep are split across threads */
+	std::vector<const FlowField*> field;
+	for ( size_t i = 0; i < store.size(); i++ ){
+		const int goal = store.goal(i);
+		if ( goal < 0 ) continue;
+		if ( (size_t)goal >= field.size() ) field.resize(goal + 1, NULL);
+		if ( !field[goal] ) field[goal] = tilemap.flow_field(goal);
+	}
 
-	slow_buff.tick(dt);
-	poison_buff.tick(dt);
+	/* each creep only reads and writes its own slot */
+	pool.parallel_for(store.size(), grain, [&field, dt](size_t begin, size_t end){
+		for ( size_t i = begin; i < end; i++ ){
+			const int goal = store.goal(i);
+			if ( goal < 0 || !field[goal] ) continue;
+			store.set_dst(i, field[goal]->steer(store.pos(i) + half));
+		}
+
+		store.tick(begin, end, dt);
+
+		for ( size_t i = begin; i < end; i++ ){
+			store.creep(i)->pos = store.pos(i);
+		}
+	});
+
+	/* poison is applied afterwards as it might kill the creep */
+	for ( size_t i = 0; i < store.size(); i++ ){
+		const float amount = store.poison_damage(i);
+		if ( amount > 0.0f ){
+			Creep* creep = store.creep(i);
+			creep->damage(amount, store.poison_source(i));
+		}
+	}
 }
 
 float Creep::speed() const {
-	float base = Entity::speed();
-
-	if ( slow_buff.duration > 0.0 ){
-		base *= slow_buff.amount;
-	}
-
-	return base;
+	return store.speed(state);
 }
 
 void Creep::on_enter_region(const Waypoint& region){
-	if ( region.name() == "middle" ){
-		kill(NULL);
+	if ( region.is_exit() ){
+		kill(Handle());
 		return;
 	}
 
-	std::string name = region.next();
+	const std::string* name = &region.next();
+	const Waypoint* next = region.next_waypoint();
 	if ( --left == 0 ){
-		name = region.inner();
+		name = &region.inner();
+		next = region.inner_waypoint();
 		left = 7;
 	}
 
-	if ( name == "" ){
-		fprintf(stderr, "Waypoint `%s' is missing next waypoint.\n", region.name().c_str());
-		return;
-	}
-
-	const Waypoint* next = Game::find_waypoint(name);
+	/* names are only looked at to report what is wrong */
 	if ( !next ){
-		fprintf(stderr, "Waypoint `%s' refers to non-existing waypoint `%s', ignored.\n", region.name().c_str(), region.next().c_str());
+		if ( name->empty() ){
+			fprintf(stderr, "Waypoint `%s' is missing next waypoint.\n", region.name().c_str());
+		} else {
+			fprintf(stderr, "Waypoint `%s' refers to non-existing waypoint `%s', ignored.\n", region.name().c_str(), name->c_str());
+		}
 		return;
 	}
 
-	set_dst(next->middle());
+	set_goal(next);
+}
+
+void Creep::on_kill(){
+	Game::remove_creep(handle());
 }
 
 void Creep::on_exit_region(const Waypoint& region){
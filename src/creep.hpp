@@ -1,41 +1,68 @@
 #ifndef FROBNICATOR_CREEP_H
 #define FROBNICATOR_CREEP_H
 
+#include "arena.hpp"
 #include "entity.hpp"
 #include "buff.hpp"
 
 class Creep: public Entity {
 public:
+	/**
+	 * Reserve memory for a wave of creep, the following spawns are allocated
+	 * from it.
+	 */
+	static void begin_wave(size_t amount);
+
 	/**
 	 * Spawn new creep at world space coordinate given by pos.
 	 */
-	static Creep* spawn_at(const Vector2f& pos, const Blueprint* blueprint, unsigned int level){
-		return new Creep(pos, blueprint, level);
-	}
+	static Creep* spawn_at(const Vector2f& pos, const Blueprint* blueprint, unsigned int level);
+
+	/**
+	 * Destroy a creep which has been removed from the world, i.e. when the
+	 * pool is collected at the end of a tick. The memory of a wave is released
+	 * along with its last creep.
+	 */
+	static void release(Creep* creep);
+
+	/**
+	 * Free the current wave arena when a level is torn down. All creep must
+	 * have been released, which frees every other arena.
+	 */
+	static void end_waves();
 
 	void add_buff(const SlowBuff& buf);
-	void add_buff(const PoisonBuff& buf);
+	void add_buff(const PoisonBuff& buf, const Handle& source);
 
 	/**
 	 * Mark what region it currently is in.
+	 * @param id Waypoint id or -1 if outside any region.
 	 */
-	Creep& set_region(const std::string& name);
+	Creep& set_region(int id);
 
 	/**
 	 * Get what region it is currently in.
-	 * @return Empty string if outside any region.
+	 * @return Waypoint id or -1 if outside any region.
 	 */
-	std::string get_region() const;
+	int get_region() const;
 
 	/**
-	 * Set where it is going.
+	 * Set which waypoint it is going to, it follows the flow field of the
+	 * waypoint to get there.
 	 */
-	Creep& set_dst(const Vector2f& dst);
+	Creep& set_goal(const Waypoint* goal);
 
-	virtual void tick(float dt);
+	/**
+	 * Steer all creep along the flow fields of their goals and update
+	 * movement and buffs. Movement is spread over the pool, poison damage is
+	 * applied afterwards in creep order.
+	 */
+	static void tick_all(const Tilemap& tilemap, ThreadPool& pool, float dt);
 
 	virtual float speed() const;
 
+	virtual void on_kill();
+
 	/** Triggers **/
 
 	/**
@@ -49,15 +76,15 @@ public:
 	void on_exit_region(const Waypoint& region);
 
 private:
-	Creep(const Vector2f& pos, const Blueprint* blueprint, unsigned int level);
+	friend class Arena<Creep>;
 
-	static const std::string generate_id();
+	Creep(const Vector2f& pos, const Blueprint* blueprint, unsigned int level);
+	virtual ~Creep();
 
-	Vector2f dst;
-	std::string region;
+	Arena<Creep>* arena; /* memory the creep lives in */
+	int region;
 	int left;
-	SlowBuff slow_buff;
-	PoisonBuff poison_buff;
+	size_t state; /* index in creep store (movement and buffs) */
 };
 
 #endif /* FROBNICATOR_CREEP_H */
@@ -0,0 +1,241 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "creep_store.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/**
+ * Pointers to all lanes, passed to the kernels.
+ */
+struct Lanes {
+	float* pos_x;
+	float* pos_y;
+	const float* dst_x;
+	const float* dst_y;
+	const float* base_speed;
+	const float* slow_amount;
+	float* slow_duration;
+	const float* poison_amount;
+	float* poison_duration;
+	float* damage;
+};
+
+typedef void (*kernel_func)(const Lanes& l, size_t begin, size_t end, float dt);
+
+/* The kernels must produce bit-identical results: each uses the same
+ * operations in the same order as the reference implementation below (which
+ * is what Vector::normalized and Buff::tick used to do per creep). The
+ * destination is offset by half a tile to aim for the middle of the tile. */
+
+static void kernel_scalar(const Lanes& l, size_t begin, size_t end, float dt){
+	for ( size_t i = begin; i < end; i++ ){
+		const float dx = (l.dst_x[i] - l.pos_x[i]) - 24.0f;
+		const float dy = (l.dst_y[i] - l.pos_y[i]) - 24.0f;
+		const float len = sqrtf(dx*dx + dy*dy);
+		const float nx = len < 0.001f ? 0.0f : dx / len;
+		const float ny = len < 0.001f ? 0.0f : dy / len;
+
+		const float speed = l.slow_duration[i] > 0.0f ? l.base_speed[i] * l.slow_amount[i] : l.base_speed[i];
+		l.pos_x[i] += (nx * speed) * dt;
+		l.pos_y[i] += (ny * speed) * dt;
+
+		const float slow = l.slow_duration[i] - dt;
+		l.slow_duration[i] = slow > 0.0f ? slow : 0.0f;
+
+		l.damage[i] = l.poison_duration[i] > 0.0f ? l.poison_amount[i] * dt : 0.0f;
+		const float poison = l.poison_duration[i] - dt;
+		l.poison_duration[i] = poison > 0.0f ? poison : 0.0f;
+	}
+}
+
+#if defined(HAVE_X86_KERNELS) && defined(__SSE2__)
+static void kernel_sse2(const Lanes& l, size_t begin, size_t end, float dt){
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(24.0f);
+	const __m128 epsilon = _mm_set1_ps(0.001f);
+
+	size_t i = begin;
+	for ( ; i + 4 <= end; i += 4 ){
+		__m128 px = _mm_loadu_ps(l.pos_x + i);
+		__m128 py = _mm_loadu_ps(l.pos_y + i);
+		const __m128 dx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(l.dst_x + i), px), half);
+		const __m128 dy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(l.dst_y + i), py), half);
+		const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+		const __m128 small = _mm_cmplt_ps(len, epsilon);
+		const __m128 nx = _mm_andnot_ps(small, _mm_div_ps(dx, len));
+		const __m128 ny = _mm_andnot_ps(small, _mm_div_ps(dy, len));
+
+		const __m128 base = _mm_loadu_ps(l.base_speed + i);
+		const __m128 slow = _mm_loadu_ps(l.slow_duration + i);
+		const __m128 slowed = _mm_cmpgt_ps(slow, zero);
+		const __m128 speed = _mm_or_ps(
+			_mm_and_ps(slowed, _mm_mul_ps(base, _mm_loadu_ps(l.slow_amount + i))),
+			_mm_andnot_ps(slowed, base));
+
+		px = _mm_add_ps(px, _mm_mul_ps(_mm_mul_ps(nx, speed), vdt));
+		py = _mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(ny, speed), vdt));
+		_mm_storeu_ps(l.pos_x + i, px);
+		_mm_storeu_ps(l.pos_y + i, py);
+		_mm_storeu_ps(l.slow_duration + i, _mm_max_ps(_mm_sub_ps(slow, vdt), zero));
+
+		const __m128 poison = _mm_loadu_ps(l.poison_duration + i);
+		const __m128 poisoned = _mm_cmpgt_ps(poison, zero);
+		_mm_storeu_ps(l.damage + i, _mm_and_ps(poisoned, _mm_mul_ps(_mm_loadu_ps(l.poison_amount + i), vdt)));
+		_mm_storeu_ps(l.poison_duration + i, _mm_max_ps(_mm_sub_ps(poison, vdt), zero));
+	}
+
+	kernel_scalar(l, i, end, dt);
+}
+#endif
+
+#if defined(HAVE_X86_KERNELS) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static void kernel_avx2(const Lanes& l, size_t begin, size_t end, float dt){
+	const __m256 vdt = _mm256_set1_ps(dt);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 half = _mm256_set1_ps(24.0f);
+	const __m256 epsilon = _mm256_set1_ps(0.001f);
+
+	size_t i = begin;
+	for ( ; i + 8 <= end; i += 8 ){
+		__m256 px = _mm256_loadu_ps(l.pos_x + i);
+		__m256 py = _mm256_loadu_ps(l.pos_y + i);
+		const __m256 dx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(l.dst_x + i), px), half);
+		const __m256 dy = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(l.dst_y + i), py), half);
+		const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+		const __m256 small = _mm256_cmp_ps(len, epsilon, _CMP_LT_OQ);
+		const __m256 nx = _mm256_andnot_ps(small, _mm256_div_ps(dx, len));
+		const __m256 ny = _mm256_andnot_ps(small, _mm256_div_ps(dy, len));
+
+		const __m256 base = _mm256_loadu_ps(l.base_speed + i);
+		const __m256 slow = _mm256_loadu_ps(l.slow_duration + i);
+		const __m256 slowed = _mm256_cmp_ps(slow, zero, _CMP_GT_OQ);
+		const __m256 speed = _mm256_blendv_ps(base, _mm256_mul_ps(base, _mm256_loadu_ps(l.slow_amount + i)), slowed);
+
+		px = _mm256_add_ps(px, _mm256_mul_ps(_mm256_mul_ps(nx, speed), vdt));
+		py = _mm256_add_ps(py, _mm256_mul_ps(_mm256_mul_ps(ny, speed), vdt));
+		_mm256_storeu_ps(l.pos_x + i, px);
+		_mm256_storeu_ps(l.pos_y + i, py);
+		_mm256_storeu_ps(l.slow_duration + i, _mm256_max_ps(_mm256_sub_ps(slow, vdt), zero));
+
+		const __m256 poison = _mm256_loadu_ps(l.poison_duration + i);
+		const __m256 poisoned = _mm256_cmp_ps(poison, zero, _CMP_GT_OQ);
+		_mm256_storeu_ps(l.damage + i, _mm256_and_ps(poisoned, _mm256_mul_ps(_mm256_loadu_ps(l.poison_amount + i), vdt)));
+		_mm256_storeu_ps(l.poison_duration + i, _mm256_max_ps(_mm256_sub_ps(poison, vdt), zero));
+	}
+
+	kernel_scalar(l, i, end, dt);
+}
+#endif
+
+/**
+ * Select the best kernel supported by the cpu. Can be overridden by setting
+ * FROB_KERNEL to "scalar", "sse2" or "avx2" (if supported).
+ */
+static kernel_func select_kernel(const char** name){
+	const char* force = getenv("FROB_KERNEL");
+
+#ifdef HAVE_AVX2_KERNEL
+	if ( __builtin_cpu_supports("avx2") && (!force || strcmp(force, "avx2") == 0) ){
+		*name = "avx2";
+		return kernel_avx2;
+	}
+#endif
+
+#if defined(HAVE_X86_KERNELS) && defined(__SSE2__)
+	if ( !force || strcmp(force, "scalar") != 0 ){
+		*name = "sse2";
+		return kernel_sse2;
+	}
+#endif
+
+	*name = "scalar";
+	return kernel_scalar;
+}
+
+static const char* kernel_name_cache = NULL;
+
+static kernel_func kernel(){
+	static kernel_func func = select_kernel(&kernel_name_cache);
+	return func;
+}
+
+const char* CreepStore::kernel_name(){
+	kernel();
+	return kernel_name_cache;
+}
+
+size_t CreepStore::add(Creep* creep, const Vector2f& pos, float speed){
+	owner.push_back(creep);
+	pos_x.push_back(pos.x);
+	pos_y.push_back(pos.y);
+	dst_x.push_back(0.0f);
+	dst_y.push_back(0.0f);
+	base_speed.push_back(speed);
+	slow_amount.push_back(0.0f);
+	slow_duration.push_back(0.0f);
+	poison_amount.push_back(0.0f);
+	poison_duration.push_back(0.0f);
+	damage.push_back(0.0f);
+	goals.push_back(-1);
+	poison_sources.push_back(Handle());
+	return owner.size() - 1;
+}
+
+template <class T>
+static void swap_remove(std::vector<T>& v, size_t index){
+	v[index] = v.back();
+	v.pop_back();
+}
+
+Creep* CreepStore::remove(size_t index){
+	const bool last = index == owner.size() - 1;
+
+	swap_remove(owner, index);
+	swap_remove(pos_x, index);
+	swap_remove(pos_y, index);
+	swap_remove(dst_x, index);
+	swap_remove(dst_y, index);
+	swap_remove(base_speed, index);
+	swap_remove(slow_amount, index);
+	swap_remove(slow_duration, index);
+	swap_remove(poison_amount, index);
+	swap_remove(poison_duration, index);
+	swap_remove(damage, index);
+	swap_remove(goals, index);
+	swap_remove(poison_sources, index);
+
+	return last ? NULL : owner[index];
+}
+
+float CreepStore::speed(size_t i) const {
+	return slow_duration[i] > 0.0f ? base_speed[i] * slow_amount[i] : base_speed[i];
+}
+
+void CreepStore::tick(size_t begin, size_t end, float dt){
+	if ( begin >= end ) return;
+
+	Lanes l;
+	l.pos_x = pos_x.data();
+	l.pos_y = pos_y.data();
+	l.dst_x = dst_x.data();
+	l.dst_y = dst_y.data();
+	l.base_speed = base_speed.data();
+	l.slow_amount = slow_amount.data();
+	l.slow_duration = slow_duration.data();
+	l.poison_amount = poison_amount.data();
+	l.poison_duration = poison_duration.data();
+	l.damage = damage.data();
+
+	kernel()(l, begin, end, dt);
+}
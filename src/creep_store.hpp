@@ -0,0 +1,93 @@
+#ifndef FROBNICATOR_CREEP_STORE_H
+#define FROBNICATOR_CREEP_STORE_H
+
+#include "pool.hpp"
+#include "vector.hpp"
+#include <cstddef>
+#include <vector>
+
+/**
+ * Structure-of-arrays storage for the per-tick creep state (movement and
+ * buffs), updated for all creep at once by a vectorized kernel.
+ *
+ * Slots are kept dense by moving the last slot into removed ones, so indices
+ * are not stable across remove().
+ */
+class CreepStore {
+public:
+	/**
+	 * Add creep.
+	 * @param speed Base speed (before slow).
+	 * @return Index of the new slot.
+	 */
+	size_t add(Creep* owner, const Vector2f& pos, float speed);
+
+	/**
+	 * Remove slot.
+	 * @return Creep which was moved into the slot or NULL if none was.
+	 */
+	Creep* remove(size_t index);
+
+	/**
+	 * Move creep [begin, end) towards their destination and tick slow and
+	 * poison. Poison damage is not applied, it is written to poison_damage().
+	 * Only the given slots are touched so ranges can be ticked concurrently.
+	 */
+	void tick(size_t begin, size_t end, float dt);
+
+	size_t size() const { return owner.size(); }
+	Creep* creep(size_t i) const { return owner[i]; }
+
+	Vector2f pos(size_t i) const { return Vector2f(pos_x[i], pos_y[i]); }
+	void set_dst(size_t i, const Vector2f& dst){ dst_x[i] = dst.x; dst_y[i] = dst.y; }
+
+	/**
+	 * Waypoint id the creep is heading for or -1 if none.
+	 */
+	int goal(size_t i) const { return goals[i]; }
+	void set_goal(size_t i, int id){ goals[i] = id; }
+
+	/**
+	 * Current speed, including slow.
+	 */
+	float speed(size_t i) const;
+
+	void set_slow(size_t i, float amount, float duration){ slow_amount[i] = amount; slow_duration[i] = duration; }
+	void set_poison(size_t i, float amount, float duration, const Handle& source){
+		poison_amount[i] = amount;
+		poison_duration[i] = duration;
+		poison_sources[i] = source;
+	}
+
+	/**
+	 * Tower which applied the poison, credited if the poison kills.
+	 */
+	const Handle& poison_source(size_t i) const { return poison_sources[i]; }
+
+	/**
+	 * Damage taken from poison during the last tick.
+	 */
+	float poison_damage(size_t i) const { return damage[i]; }
+
+	/**
+	 * Name of the kernel in use (e.g. "avx2").
+	 */
+	static const char* kernel_name();
+
+private:
+	std::vector<Creep*> owner;
+	std::vector<float> pos_x;
+	std::vector<float> pos_y;
+	std::vector<float> dst_x;
+	std::vector<float> dst_y;
+	std::vector<float> base_speed;
+	std::vector<float> slow_amount;
+	std::vector<float> slow_duration;
+	std::vector<float> poison_amount;
+	std::vector<float> poison_duration;
+	std::vector<float> damage;
+	std::vector<int> goals;
+	std::vector<Handle> poison_sources; /* not used by the kernel */
+};
+
+#endif /* FROBNICATOR_CREEP_STORE_H */
@@ -7,20 +7,16 @@
 #include "game.hpp"
 #include "waypoint.hpp"
 #include <cstdio>
-#include <sstream>
-#include <iomanip>
 
 #ifdef WIN32
 #define strdup _strdup
 extern "C" char* strndup(const char* src, size_t n);
 #endif
 
-Entity::Entity(const std::string& id, const Vector2f& pos, const Blueprint* blueprint, unsigned int level)
+Entity::Entity(const Vector2f& pos, const Blueprint* blueprint, unsigned int level)
 	: level(level)
 	, pos(pos)
-	, blueprint(blueprint)
-	, _id(id)
-	, references(1) {
+	, blueprint(blueprint) {
 
 	hp = max_hp();
 }
@@ -41,36 +37,29 @@ const std::string Entity::name() const {
 	return blueprint->name(level);
 }
 
-const std::string Entity::id() const {
-	return _id;
+const Blueprint* Entity::get_blueprint() const {
+	return blueprint;
 }
 
-int Entity::current_level() const { return level; }
-int Entity::cost()     const { return blueprint->data[level].cost; }
-float Entity::splash() const { return blueprint->data[level].splash; }
-float Entity::damage() const { return blueprint->data[level].damage; }
-float Entity::rof()    const { return blueprint->data[level].rof; }
-float Entity::range()  const { return blueprint->data[level].range; }
-float Entity::slow()   const { return blueprint->data[level].slow; }
-float Entity::slow_duration() const { return blueprint->data[level].slow_duration; }
-float Entity::poison() const { return blueprint->data[level].poison; }
-float Entity::poison_duration() const { return blueprint->data[level].poison_duration; }
-float Entity::speed()  const { return blueprint->data[level].speed; }
-float Entity::armor()  const { return blueprint->data[level].armor; }
-float Entity::max_hp()  const { return blueprint->data[level].hp; }
-float Entity::current_hp()  const { return hp; }
-bool Entity::is_alive() const { return hp > 0.0; }
+const Handle& Entity::handle() const {
+	return _handle;
+}
+
+void Entity::set_handle(const Handle& handle){
+	_handle = handle;
+}
 
-void Entity::kill(Entity* who){
-	if ( who ){
+
+void Entity::kill(const Handle& who){
+	if ( who.valid() ){
 		Game::transaction(-cost(), world_pos());
 	} else {
 		Game::mutilate();
 	}
-	Game::remove_entity(id());
+	on_kill();
 }
 
-void Entity::damage(float amount, Entity* who){
+void Entity::damage(float amount, const Handle& who){
 	if ( !is_alive() ) return;
 
 	hp -= amount;
@@ -78,13 +67,3 @@ void Entity::damage(float amount, Entity* who){
 		kill(who);
 	}
 }
-
-void Entity::inc_ref() const {
-	references++;
-}
-
-void Entity::dec_ref() const {
-	if ( --references == 0 ){
-		delete this;
-	}
-}
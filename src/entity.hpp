@@ -1,11 +1,15 @@
 #ifndef DVB021_ENTITY_H
 #define DVB021_ENTITY_H
 
+#include "blueprint.hpp"
+#include "pool.hpp"
 #include "vector.hpp"
 #include <string>
 
 class Entity {
 public:
+	virtual ~Entity(){}
+
 	/**
 	 * Position in worldspace.
 	 */
@@ -18,6 +22,7 @@ public:
 
 	const Sprite* sprite() const;
 	const std::string name() const;
+	const Blueprint* get_blueprint() const;
 
 	/**
 	 * Update entity. Should be called every frame.
@@ -25,51 +30,62 @@ public:
 	virtual void tick(float dt){}
 
 	/**
-	 * Get name of entity.
+	 * Handle to this entity in the world, invalid until added.
+	 */
+	const Handle& handle() const;
+	void set_handle(const Handle& handle);
+
+	/**
+	 * Stat at the current level.
 	 */
-	const std::string id() const;
+	template <Blueprint::Stat S>
+	float stat() const {
+		return blueprint->stat<S>(level);
+	}
 
-	int current_level() const;
-	int cost() const;
-	float splash() const;
-	float damage() const;
-	float rof() const;
-	float range() const;
-	float slow() const;
-	float slow_duration() const;
-	float poison() const;
-	float poison_duration() const;
-	virtual float speed() const;
-	float armor() const;
-	float max_hp() const;
-	float current_hp() const;
-	bool is_alive() const;
+	int current_level() const { return level; }
+	int cost() const { return blueprint->cost(level); }
+	float splash() const { return stat<Blueprint::SPLASH>(); }
+	float damage() const { return stat<Blueprint::DAMAGE>(); }
+	float rof() const { return stat<Blueprint::ROF>(); }
+	float range() const { return stat<Blueprint::RANGE>(); }
+	float slow() const { return stat<Blueprint::SLOW>(); }
+	float slow_duration() const { return stat<Blueprint::SLOW_DURATION>(); }
+	float poison() const { return stat<Blueprint::POISON>(); }
+	float poison_duration() const { return stat<Blueprint::POISON_DURATION>(); }
+	virtual float speed() const { return stat<Blueprint::SPEED>(); }
+	float armor() const { return stat<Blueprint::ARMOR>(); }
+	float max_hp() const { return stat<Blueprint::HP>(); }
+	float current_hp() const { return hp; }
+	bool is_alive() const { return hp > 0.0; }
 
 	/**
 	 * Kill this entity.
+	 * @param who Handle to whoever killed it, or an invalid handle if it
+	 *            escaped (costs a life instead of giving a bounty).
 	 */
-	void kill(Entity* who);
+	void kill(const Handle& who);
 
 	/**
 	 * Damage this entity.
+	 * @param who See kill.
 	 */
-	void damage(float amount, Entity* who);
+	void damage(float amount, const Handle& who);
 
+	/**
+	 * Called when killed, responsible for removing the entity from the world.
+	 */
 	virtual void on_kill(){}
 
-	void inc_ref() const;
-	void dec_ref() const;
-
 protected:
-	Entity(const std::string& id, const Vector2f& pos, const Blueprint* blueprint, unsigned int level);
+	Entity(const Vector2f& pos, const Blueprint* blueprint, unsigned int level);
 	size_t level;
 	Vector2f pos;
 	float hp;
 	const Blueprint* blueprint;
 
 private:
-	const std::string _id;
-	mutable int references;
+	Handle _handle;
 };
 
 #endif /* DVB021_ENTITY_H */
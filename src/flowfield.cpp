@@ -0,0 +1,306 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "flowfield.hpp"
+#include "region.hpp"
+#include "tilemap.hpp"
+#include <algorithm>
+#include <math.h>
+
+/* Directions 0-3 are straight steps and 4-7 diagonal, the order is also used
+ * to break ties so the field is the same every time it is computed. */
+static const int dx[8] = { 0, 1, 0, -1,  1, 1, -1, -1};
+static const int dy[8] = {-1, 0, 1,  0, -1, 1,  1, -1};
+static const uint32_t step[8] = {10, 10, 10, 10, 14, 14, 14, 14};
+
+/* direction of goal cells and cells without a path */
+static const uint8_t goal_cell = 8;
+static const uint8_t no_path = 9;
+
+const uint32_t FlowField::unreachable;
+
+static int opposite(int d){
+	return d < 4 ? (d + 2) % 4 : 4 + (d - 2) % 4;
+}
+
+FlowField::FlowField(const Tilemap& tilemap, const Region& goal)
+	: tilemap(tilemap)
+	, goal(goal)
+	, cells(tilemap.begin())
+	, num_cells(tilemap.end() - tilemap.begin())
+	, width(tilemap.map_width())
+	, height(tilemap.map_height()) {
+
+	const float tw = (float)tilemap.tile_width();
+	const float th = (float)tilemap.tile_height();
+	goal_x0 = std::max(0,      (int)ceilf(goal.x() / tw - 0.5f));
+	goal_y0 = std::max(0,      (int)ceilf(goal.y() / th - 0.5f));
+	goal_x1 = std::min(width,  (int)ceilf((goal.x() + goal.w()) / tw - 0.5f));
+	goal_y1 = std::min(height, (int)ceilf((goal.y() + goal.h()) / th - 0.5f));
+
+	/* regions smaller than a cell uses the cell with the middle of the region */
+	if ( goal_x0 >= goal_x1 || goal_y0 >= goal_y1 ){
+		const Vector2f middle = goal.middle();
+		goal_x0 = (int)floorf(middle.x / tw);
+		goal_y0 = (int)floorf(middle.y / th);
+		goal_x1 = goal_x0 + 1;
+		goal_y1 = goal_y0 + 1;
+	}
+
+	const size_t size = (size_t)width * height;
+	integration.assign(size, unreachable);
+	direction.assign(size, no_path);
+	mark.assign(size, 0);
+
+	Seeds seeds;
+	for ( int y = goal_y0; y < goal_y1; y++ ){
+		for ( int x = goal_x0; x < goal_x1; x++ ){
+			if ( !walkable(x, y) ) continue;
+			const uint32_t cell = y * width + x;
+			integration[cell] = 0;
+			direction[cell] = goal_cell;
+			seed(seeds, cell);
+		}
+	}
+	propagate(seeds);
+}
+
+void FlowField::block(const Vector2i& pos, const Vector2i& size){
+	std::vector<uint32_t> affected;
+	auto affect = [this, &affected](uint32_t cell){
+		if ( mark[cell] ) return;
+		mark[cell] = 1;
+		affected.push_back(cell);
+	};
+
+	/* the blocked cells and neighbours which can no longer take their step
+	 * (either into a blocked cell or diagonally past one) */
+	const int x0 = std::max(pos.x - 1, 0);
+	const int y0 = std::max(pos.y - 1, 0);
+	const int x1 = std::min(pos.x + size.x + 1, width);
+	const int y1 = std::min(pos.y + size.y + 1, height);
+	for ( int y = y0; y < y1; y++ ){
+		for ( int x = x0; x < x1; x++ ){
+			const uint32_t cell = y * width + x;
+			if ( integration[cell] == unreachable ) continue;
+			if ( !walkable(x, y) || (direction[cell] < 8 && !can_move(cell, direction[cell])) ){
+				affect(cell);
+			}
+		}
+	}
+
+	/* everything downstream of them */
+	for ( size_t i = 0; i < affected.size(); i++ ){
+		const uint32_t cell = affected[i];
+		const int x = cell % width;
+		const int y = cell / width;
+		for ( int d = 0; d < 8; d++ ){
+			const int nx = x + dx[d];
+			const int ny = y + dy[d];
+			if ( nx < 0 || ny < 0 || nx >= width || ny >= height ) continue;
+			const uint32_t neighbour = ny * width + nx;
+			if ( direction[neighbour] == opposite(d) ){
+				affect(neighbour);
+			}
+		}
+	}
+
+	/* recompute from the unaffected cells around them */
+	for ( auto it = affected.begin(); it != affected.end(); ++it ){
+		integration[*it] = unreachable;
+		direction[*it] = no_path;
+	}
+
+	Seeds seeds;
+	for ( auto it = affected.begin(); it != affected.end(); ++it ){
+		const uint32_t cell = *it;
+		mark[cell] = 0;
+		if ( !walkable(cell % width, cell / width) ) continue;
+
+		int d = no_path;
+		const uint32_t cost = best_neighbour(cell, &d);
+		if ( cost == unreachable ) continue;
+		integration[cell] = cost;
+		direction[cell] = d;
+		seed(seeds, cell);
+	}
+	propagate(seeds);
+}
+
+void FlowField::unblock(const Vector2i& pos, const Vector2i& size){
+	/* new cells and their neighbours, which might be able to step diagonally
+	 * past them now */
+	Seeds seeds;
+	const int x0 = std::max(pos.x - 1, 0);
+	const int y0 = std::max(pos.y - 1, 0);
+	const int x1 = std::min(pos.x + size.x + 1, width);
+	const int y1 = std::min(pos.y + size.y + 1, height);
+	for ( int y = y0; y < y1; y++ ){
+		for ( int x = x0; x < x1; x++ ){
+			if ( !walkable(x, y) ) continue;
+			const uint32_t cell = y * width + x;
+
+			if ( is_goal(cell) ){
+				if ( integration[cell] == 0 ) continue;
+				integration[cell] = 0;
+				direction[cell] = goal_cell;
+				seed(seeds, cell);
+				continue;
+			}
+
+			int d = no_path;
+			const uint32_t cost = best_neighbour(cell, &d);
+			if ( cost >= integration[cell] ) continue;
+			integration[cell] = cost;
+			direction[cell] = d;
+			seed(seeds, cell);
+		}
+	}
+	propagate(seeds);
+}
+
+Vector2f FlowField::steer(const Vector2f& pos) const {
+	const float tw = (float)tilemap.tile_width();
+	const float th = (float)tilemap.tile_height();
+	const int x = (int)floorf(pos.x / tw);
+	const int y = (int)floorf(pos.y / th);
+	if ( x < 0 || y < 0 || x >= width || y >= height ){
+		return goal.middle();
+	}
+
+	const uint32_t cell = y * width + x;
+	int d = direction[cell];
+
+	/* standing inside a building (placed on top of the creep), walk out to the
+	 * cheapest neighbour */
+	if ( d == no_path && !walkable(x, y) ){
+		uint32_t best = unreachable;
+		for ( int i = 0; i < 8; i++ ){
+			const int nx = x + dx[i];
+			const int ny = y + dy[i];
+			if ( nx < 0 || ny < 0 || nx >= width || ny >= height ) continue;
+			const uint32_t cost = integration[ny * width + nx];
+			if ( cost < best ){
+				best = cost;
+				d = i;
+			}
+		}
+	}
+
+	if ( d >= 8 ){
+		return goal.middle();
+	}
+
+	return Vector2f(((float)(x + dx[d]) + 0.5f) * tw, ((float)(y + dy[d]) + 0.5f) * th);
+}
+
+uint32_t FlowField::cost(size_t x, size_t y) const {
+	if ( x >= (size_t)width || y >= (size_t)height ) return unreachable;
+	return integration[y * width + x];
+}
+
+bool FlowField::walkable(int x, int y) const {
+	if ( x < 0 || y < 0 || x >= width || y >= height ) return false;
+
+	/* cells missing from the map (already warned about) are walkable */
+	const size_t index = (size_t)y * width + x;
+	return index >= num_cells || !cells[index].blocked();
+}
+
+bool FlowField::can_move(uint32_t cell, int d) const {
+	const int x = cell % width;
+	const int y = cell / width;
+	if ( !walkable(x + dx[d], y + dy[d]) ) return false;
+	return d < 4 || (walkable(x + dx[d], y) && walkable(x, y + dy[d]));
+}
+
+bool FlowField::is_goal(uint32_t cell) const {
+	const int x = cell % width;
+	const int y = cell / width;
+	return x >= goal_x0 && x < goal_x1 && y >= goal_y0 && y < goal_y1;
+}
+
+/**
+ * Cheapest path through any neighbour.
+ */
+uint32_t FlowField::best_neighbour(uint32_t cell, int* best) const {
+	const int x = cell % width;
+	const int y = cell / width;
+	uint32_t cost = unreachable;
+
+	for ( int d = 0; d < 8; d++ ){
+		if ( !can_move(cell, d) ) continue;
+		const uint32_t neighbour = integration[(y + dy[d]) * width + (x + dx[d])];
+		if ( neighbour == unreachable ) continue;
+		if ( neighbour + step[d] < cost ){
+			cost = neighbour + step[d];
+			*best = d;
+		}
+	}
+
+	return cost;
+}
+
+void FlowField::seed(Seeds& seeds, uint32_t cell) const {
+	seeds.push_back(std::make_pair(integration[cell], cell));
+}
+
+/**
+ * Dijkstra from the seeded cells, lowering the cost of every cell which has a
+ * cheaper path through them. As costs only increase by 10 or 14 per step a
+ * bucket queue covering the next 15 costs is enough, seeds are sorted and
+ * added when the search reaches their cost.
+ */
+void FlowField::propagate(Seeds& seeds){
+	if ( seeds.empty() ) return;
+	std::sort(seeds.begin(), seeds.end());
+
+	size_t next = 0;
+	size_t pending = 0;
+	uint32_t cost = seeds[0].first;
+	for (;;){
+		std::vector<uint32_t>& current = bucket[cost % num_buckets];
+		for ( ; next < seeds.size() && seeds[next].first == cost; next++ ){
+			current.push_back(seeds[next].second);
+			pending++;
+		}
+
+		for ( size_t i = 0; i < current.size(); i++ ){
+			const uint32_t cell = current[i];
+
+			/* stale entry, cell has been lowered since it was queued */
+			if ( integration[cell] != cost ) continue;
+
+			const int x = cell % width;
+			const int y = cell / width;
+			for ( int d = 0; d < 8; d++ ){
+				const int nx = x + dx[d];
+				const int ny = y + dy[d];
+				if ( !walkable(nx, ny) ) continue;
+
+				/* step from the neighbour into this cell */
+				const uint32_t neighbour = ny * width + nx;
+				const int back = opposite(d);
+				if ( !can_move(neighbour, back) ) continue;
+				if ( cost + step[d] >= integration[neighbour] ) continue;
+
+				integration[neighbour] = cost + step[d];
+				direction[neighbour] = back;
+				bucket[(cost + step[d]) % num_buckets].push_back(neighbour);
+				pending++;
+			}
+		}
+
+		pending -= current.size();
+		current.clear();
+
+		if ( pending > 0 ){
+			cost++;
+		} else if ( next < seeds.size() ){
+			cost = seeds[next].first;
+		} else {
+			break;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef FROBNICATOR_FLOWFIELD_H
+#define FROBNICATOR_FLOWFIELD_H
+
+#include "tilemap.hpp"
+#include "vector.hpp"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Shortest paths from every cell of a tilemap to one goal region, shared by
+ * all creep heading for that goal so steering is a single lookup per creep.
+ * The waypoint graph is the coarse level of the search: creep still move from
+ * waypoint to waypoint and there is one field per waypoint.
+ *
+ * The integration field holds the cost of the cheapest path to the goal (10
+ * per straight step, 14 per diagonal step) and the flow field the direction
+ * to take from each cell. Cells blocked by buildings are not walkable and
+ * diagonal steps may not cut the corner of a blocked cell. When buildings are
+ * placed or removed only the cells whose paths changed are recomputed.
+ */
+class FlowField {
+public:
+	static const uint32_t unreachable = 0xFFFFFFFF;
+
+	/**
+	 * Compute field towards goal. Goal cells are all cells with the middle
+	 * inside the region.
+	 */
+	FlowField(const Tilemap& tilemap, const Region& goal);
+
+	/**
+	 * Update field after cells in area has become blocked.
+	 */
+	void block(const Vector2i& pos, const Vector2i& size);
+
+	/**
+	 * Update field after cells in area has become walkable.
+	 */
+	void unblock(const Vector2i& pos, const Vector2i& size);
+
+	/**
+	 * Get the point to steer towards from a world position (middle of the
+	 * creep). This is the middle of the next cell on the path or the middle of
+	 * the goal region once inside it, or if the goal cannot be reached.
+	 */
+	Vector2f steer(const Vector2f& pos) const;
+
+	/**
+	 * Path cost from cell to goal or unreachable.
+	 */
+	uint32_t cost(size_t x, size_t y) const;
+
+private:
+	typedef std::vector<std::pair<uint32_t, uint32_t>> Seeds; /* (cost, cell) */
+	static const size_t num_buckets = 15; /* longest step + 1 */
+
+	bool walkable(int x, int y) const;
+	bool can_move(uint32_t cell, int direction) const;
+	bool is_goal(uint32_t cell) const;
+	uint32_t best_neighbour(uint32_t cell, int* direction) const;
+	void seed(Seeds& seeds, uint32_t cell) const;
+	void propagate(Seeds& seeds);
+
+	const Tilemap& tilemap;
+	const Region& goal;
+	const Tilemap::Tile* cells;
+	size_t num_cells;
+	int width;
+	int height;
+	int goal_x0, goal_y0, goal_x1, goal_y1; /* goal cells, exclusive upper bound */
+	std::vector<uint32_t> integration;  /* cost per cell */
+	std::vector<uint8_t> direction;     /* per cell, see flowfield.cpp */
+	std::vector<uint8_t> mark;          /* scratch when blocking, all zero between calls */
+	std::vector<uint32_t> bucket[num_buckets]; /* scratch, cells queued by cost modulo num_buckets */
+};
+
+#endif /* FROBNICATOR_FLOWFIELD_H */
@@ -3,12 +3,16 @@
 
 class Backend;
 class Blueprint;
+class Building;
 class Creep;
 class Level;
 class Entity;
+class FlowField;
 class Projectile;
+class Random;
 class Region;
 class Sprite;
+class ThreadPool;
 class Tilemap;
 class Waypoint;
 
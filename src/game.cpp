@@ -8,18 +8,32 @@
 #include "building.hpp"
 #include "common.hpp"
 #include "creep.hpp"
+#include "creep_store.hpp"
 #include "entity.hpp"
+#include "hash.hpp"
 #include "level.hpp"
+#include "loader.hpp"
+#include "profiler.hpp"
 #include "projectile.hpp"
+#include "random.hpp"
+#include "render_list.hpp"
+#include "replay.hpp"
+#include "snapshot.hpp"
+#include "spatial.hpp"
 #include "sprite.hpp"
+#include "thread_pool.hpp"
 #include "tilemap.hpp"
+#include "triple_buffer.hpp"
 #include "waypoint.hpp"
 #include <cstdlib>
 #include <cassert>
 #include <vector>
 #include <math.h>
 #include <algorithm>
+#include <atomic>
 #include <cstdarg>
+#include <mutex>
+#include <thread>
 
 #ifdef WIN32
 #define VC_EXTRALEAN
@@ -29,6 +43,7 @@
 
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/time.h>
+#include <unistd.h>
 #else
 extern "C" int gettimeofday(struct timeval* tv, struct timezone* tz);
 extern "C" void usleep (uint64_t usec);
@@ -49,15 +64,16 @@ enum Mode {
 };
 
 class Message;
-static bool running = false;
+static std::atomic<bool> running(false);
 static Backend* backend = NULL;
 static Level* level = NULL;
-static std::map<std::string, Building*> building;
-static std::map<std::string, Creep*> creep;
-static std::vector<Projectile*> projectile;
+static Pool<Building> building;
+static Pool<Creep> creep;
+static SpatialGrid<Creep> creep_grid; /* creep positions, rebuilt each tick before towers acquire targets */
+static std::vector<Projectile> projectile;
 static std::vector<Message*> messages;
 static Buildings building_selected = BUILDING_LAST;
-static Building* selected = nullptr;
+static Handle selected;
 static Mode mode = SELECT;
 static Vector2f camera;
 static Vector2f cursor;
@@ -69,8 +85,42 @@ static Vector2f panning_ref;    /* reference point when panning using mouse */
 static Vector2f panning_cur;    /* where the mouse currently is (to calculate how much to pan) */
 static bool show_waypoints = false;
 static bool show_aabb = false;
-static time_t wave_delay = 5;
+static bool show_profiler = false;
+static bool show_overview = false;
+static Profiler profiler;
+static unsigned int num_threads = 0; /* 0 means one per core */
+static ThreadPool* workers = nullptr;
+static Loader* loader = nullptr;       /* asset loading, only busy while loading */
+static std::vector<const Waypoint*> creep_region; /* scratch for region lookup, by dense creep index */
+static std::vector<Creep*> building_target;       /* scratch for tower targeting, by dense building index */
+static std::vector<char> projectile_hit;          /* scratch for projectile update */
+static std::vector<std::pair<Vector2f, Vector2f> > projectile_prev; /* endpoints before the last update, by projectile index */
+static std::vector<std::pair<uint32_t, Vector2f> > creep_published; /* (generation, position) in the last snapshot, by creep slot */
+static TripleBuffer<Snapshot> snapshots;         /* published by the simulation thread each tick, read when rendering */
+static RenderList render_list; /* snapshot entities in depth order */
+static std::vector<Snapshot::Projectile> render_projectile; /* scratch for rendering, interpolated */
+static float render_alpha = 1.0f; /* how far between the previous and the latest tick the current frame is */
+static std::mutex tilemap_lock;   /* tile flags are written by the simulation, read when rendering and by input */
+static std::mutex command_lock;
+static std::vector<Command> command_queue;   /* from input, executed at the start of the next tick */
+static std::vector<Command> command_pending; /* scratch for executing queued commands */
+static bool hover_upgrade = false; /* mouse is over the infobox buttons */
+static bool hover_sell = false;
+static const unsigned int max_framerate = 250; /* in case rendering is not paced by vsync */
+static unsigned int fps = 0; /* frames rendered during the last second */
+static const uint64_t wave_delay = 15; /* seconds between waves */
+static uint64_t next_wave = 5 * Game::tickrate; /* tick when next wave spawns */
 static int wave_left = 0;
+static uint64_t current_tick = 0;
+static uint64_t tick_limit = 0;
+static bool realtime = true;
+static Random generator;
+static uint64_t seed = 0;
+static bool seed_set = false;
+static std::string record_filename;
+static Recorder* recorder = NULL;
+static Replay* playback = NULL; /* match being replayed */
+static const uint64_t hash_interval = Game::tickrate; /* ticks between state hashes in recordings */
 static unsigned int wave_current = 0;
 static int gold = 30;
 static int lives = 100;
@@ -90,6 +140,16 @@ static Sprite* ui_sell = nullptr;
 
 namespace Game {
 	static Vector2f clamp_to_world(const Vector2f& v);
+	static void build(const Vector2i& pos, Buildings type);
+}
+
+/**
+ * Wallclock in microseconds.
+ */
+static uint64_t wallclock(){
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return (uint64_t)t.tv_sec * 1000000 + t.tv_usec;
 }
 
 class Message {
@@ -125,40 +185,44 @@ public:
 	char* msg;
 };
 
-static void poll(bool&render){
-	backend->poll(running);
+static void poll(){
+	Profiler::Scope scope(profiler, Profiler::POLL);
+	bool alive = running;
+	backend->poll(alive);
+	if ( !alive ){
+		running = false;
+	}
 }
 
-static void render_world(const Vector2f& cam){
-	backend->render_tilemap(level->tilemap(), cam);
-
-	/* retrieve all entities and sort them based on "depth" */
-	std::vector<Entity*> all;
-	std::transform(
-		creep.begin(),
-		creep.end(),
-		std::back_inserter(all),
-		[](std::map<std::string, Creep*>::value_type &pair){return pair.second;});
-	std::transform(
-		building.begin(),
-		building.end(),
-		std::back_inserter(all),
-		[](std::map<std::string, Building*>::value_type &pair){return pair.second;});
-	std::sort(
-		all.begin(),
-		all.end(),
-		[](const Entity* a, const Entity* b) -> bool {
-			return a->world_pos().y < b->world_pos().y;
-		});
+/**
+ * Position between the previous and the latest tick for the current frame.
+ */
+static Vector2f interpolate(const Vector2f& prev, const Vector2f& pos){
+	return prev + (pos - prev) * render_alpha;
+}
 
-	backend->render_entities(all, cam);
-	backend->render_projectiles(projectile, cam);
+static void render_world(const Snapshot& snap, const Vector2f& cam){
+	{
+		/* chunks read tiles when streamed in */
+		std::lock_guard<std::mutex> guard(tilemap_lock);
+		backend->render_tilemap(level->tilemap(), cam);
+	}
 
-	std::for_each(messages.begin(), messages.end(), [cam](const Message* msg){
-			Vector2f p = msg->pos - cam;
+	render_list.update(snap, render_alpha);
+	backend->render_entities(render_list.entities(), cam);
+
+	render_projectile.assign(snap.projectiles.begin(), snap.projectiles.end());
+	for ( auto it = render_projectile.begin(); it != render_projectile.end(); ++it ){
+		it->pos[0] = interpolate(it->prev[0], it->pos[0]);
+		it->pos[1] = interpolate(it->prev[1], it->pos[1]);
+	}
+	backend->render_projectiles(render_projectile, cam);
+
+	std::for_each(snap.messages.begin(), snap.messages.end(), [cam](const Snapshot::Message& msg){
+			Vector2f p = msg.pos - cam;
 			if ( p.x < 0.0f ) return; /* Font::printf wraps negative positions */
 			if ( p.y < 0.0f ) return;
-			font24->printf(p.x, p.y, msg->color, "%s", msg->msg);
+			font24->printf(p.x, p.y, msg.color, "%s", msg.text.c_str());
 	});
 }
 
@@ -184,45 +248,43 @@ static void render_waypoints(const Vector2f& cam){
 	}
 }
 
-static void render_aabb(const Vector2f& cam){
+static void render_aabb(const Snapshot& snap, const Vector2f& cam){
 	if ( !show_aabb ) return;
 
-	for ( auto it = building.begin(); it != building.end(); ++it ){
-		static float color[3] = {0,0,1};
-		backend->render_region(it->second, cam, color);
-	}
-
-	for ( auto it = creep.begin(); it != creep.end(); ++it ){
-		static float color[3] = {0,1,1};
-		backend->render_region(it->second, cam, color);
+	for ( size_t i = 0; i < snap.entities.size(); i++ ){
+		static float building_color[3] = {0,0,1};
+		static float creep_color[3] = {0,1,1};
+		Snapshot::Entity ent = snap.entities[i];
+		ent.pos = interpolate(ent.prev, ent.pos);
+		backend->render_region(&ent, cam, i < snap.num_creep ? creep_color : building_color);
 	}
 }
 
-static void render_info(const Building* building, bool b1, bool b2){
+static void render_info(const Snapshot::Building* building, bool b1, bool b2){
 	static Color c1 = Color::rgba(1,1,1,1.0f);
 	static Color c2 = Color::rgba(1,1,1,0.7f);
 
 	backend->render_begin(info_target);
 	if ( building ){
 		backend->render_clear(Color::rgba(0,0,0,0.5f));
-		font24->printf(10,  5, Color::white, "%s", building->name().c_str());
+		font24->printf(10,  5, Color::white, "%s", building->blueprint->name(building->level).c_str());
 
 		int line = 0;
-		font16->printf(10, 40+line++*16, Color::white, "Level: \t\t%d", building->current_level());
-		font16->printf(10, 40+line++*16, Color::white, "Damage: \t%.0f", building->damage());
-		font16->printf(10, 40+line++*16, Color::white, "Range: \t\t%.0f", building->range());
-		font16->printf(10, 40+line++*16, Color::white, "RoF: \t\t%.0f (per minute)", building->rof());
-		if ( building->have_slow() ){
-			font16->printf(10, 40+line++*16, Color::white, "Slows target by %.1f%% for %.1f sec", (1.0f-building->slow())*100, building->slow_duration());
+		font16->printf(10, 40+line++*16, Color::white, "Level: \t\t%d", building->level);
+		font16->printf(10, 40+line++*16, Color::white, "Damage: \t%.0f", building->damage);
+		font16->printf(10, 40+line++*16, Color::white, "Range: \t\t%.0f", building->range);
+		font16->printf(10, 40+line++*16, Color::white, "RoF: \t\t%.0f (per minute)", building->rof);
+		if ( building->have_slow ){
+			font16->printf(10, 40+line++*16, Color::white, "Slows target by %.1f%% for %.1f sec", (1.0f-building->slow)*100, building->slow_duration);
 		}
 		if ( b1 ){
-			font16->printf(10, 40+line++*16, Color::white, "Cost: \t\t%d", building->upgrade_cost());
+			font16->printf(10, 40+line++*16, Color::white, "Cost: \t\t%d", building->upgrade_cost);
 		}
 		if ( b2 ){
-			font16->printf(10, 40+line++*16, Color::white, "Income: \t\t%d (75%% of value)", building->sell_cost());
+			font16->printf(10, 40+line++*16, Color::white, "Income: \t\t%d (75%% of value)", building->sell_cost);
 		}
 
-		if ( building->can_upgrade() ){
+		if ( building->can_upgrade ){
 			backend->render_sprite(Vector2i(10,  161), ui_upgrade, b1 ? c1 : c2);
 		}
 		backend->render_sprite(Vector2i(105, 161), ui_sell,    b2 ? c1 : c2);
@@ -232,9 +294,75 @@ static void render_info(const Building* building, bool b1, bool b2){
 	backend->render_end();
 }
 
+/**
+ * Show the whole map scaled to fit the scene with the current view outlined.
+ */
+static void render_overview(const Vector2f& cam){
+	static const int margin = 20;
+	const Vector2f world(
+		(float)(tilemap->map_width()  * tilemap->tile_width()),
+		(float)(tilemap->map_height() * tilemap->tile_height()));
+	const float scale = std::min(
+		(float)(window_size.x - 2 * margin) / world.x,
+		(float)(window_size.y - ui_height - 2 * margin) / world.y);
+	const Vector2i dim((int)(world.x * scale), (int)(world.y * scale));
+	const Vector2i pos((window_size.x - dim.x) / 2, (window_size.y - ui_height - dim.y) / 2);
+
+	backend->render_overview(*tilemap, pos, dim);
+
+	const Vector2f a = Vector2f(pos.x, pos.y) + cam * scale;
+	const Vector2f b = a + Vector2f(scene_size.x, scene_size.y) * scale;
+	const Vector2f p[] = {
+		Vector2f(a.x, a.y),
+		Vector2f(b.x, a.y),
+		Vector2f(b.x, b.y),
+		Vector2f(a.x, b.y),
+		Vector2f(a.x, a.y),
+	};
+	backend->render_lines(Color::white, 1, p, 5);
+}
+
+/**
+ * Show average and worst time of each phase over the recent frames.
+ */
+static void render_profiler(){
+	Profiler::Frame avg, max;
+	profiler.summary(&avg, &max);
+
+	int y = 5;
+	font16->printf(-250, y, Color::white, "%d fps, %zd frames", fps, profiler.size());
+	y += 16;
+	font16->printf(-250, y, Color::white, "\t\t\tavg ms\tmax ms");
+	y += 16;
+	for ( int i = 0; i < Profiler::PHASE_LAST; i++ ){
+		const Profiler::Phase phase = (Profiler::Phase)i;
+		font16->printf(-250, y, Color::white, "%s\t\t%6.2f\t%6.2f",
+		               Profiler::name(phase), avg.phase[i] / 1e6, max.phase[i] / 1e6);
+		y += 16;
+	}
+	font16->printf(-250, y, Color::yellow, "frame\t\t%6.2f\t%6.2f", avg.total / 1e6, max.total / 1e6);
+}
+
+/**
+ * Render the latest snapshot, runs on the main thread while the simulation
+ * runs on its own.
+ */
 static void render_game(){
+	const Snapshot& snap = snapshots.read();
+
+	/* the snapshot was published when its tick finished, so the frame shows
+	 * the world the fraction of a tick since then after the previous tick */
+	render_alpha = 1.0f;
+	if ( realtime ){
+		const int64_t since = (int64_t)(wallclock() - snap.time);
+		render_alpha = clamp((float)since * Game::tickrate / 1e6f, 0.0f, 1.0f);
+	}
+
+	render_info(snap.find_building(selected), hover_upgrade, hover_sell);
+
 	backend->render_begin(scene_target);
 	{
+		Profiler::Scope scope(profiler, Profiler::RENDER_SCENE);
 		Vector2f panned_cam = camera;
 
 		if ( is_panning ){
@@ -243,30 +371,32 @@ static void render_game(){
 		}
 
 		backend->render_clear(Color::red);
-		render_world(panned_cam);
+		render_world(snap, panned_cam);
 		render_cursor(panned_cam);
 		render_waypoints(panned_cam);
-		render_aabb(panned_cam);
+		render_aabb(snap, panned_cam);
+		backend->render_end();
 	}
-	backend->render_end();
 
 	backend->render_begin(ui_target);
 	{
+		Profiler::Scope scope(profiler, Profiler::RENDER_UI);
 		backend->render_clear(Color::rgba(0,0,0,0.5f));
 		//backend->render_sprite(Vector2i(0,0), ui_bar_left);
 
 		for ( int i = 0; i < BUILDING_LAST; i++ ){
-			backend->render_sprite(Vector2i(150 + i * 41, 7), blueprint[i]->icon(1), gold >= blueprint[i]->cost(1) ? Color::white : Color::rgba(0.3,0.3,0.3,1));
+			backend->render_sprite(Vector2i(150 + i * 41, 7), blueprint[i]->icon(1), snap.gold >= blueprint[i]->cost(1) ? Color::white : Color::rgba(0.3,0.3,0.3,1));
 		}
-		font24->printf(   8,  5, Color::white, "Gold: %4d", gold);
-		font24->printf(   7, 22, Color::white, "Lives: %4d", lives);
-		font24->printf(-112,  5, Color::white, "Creep: %4zd", creep.size());
-		font24->printf(-150, 22, Color::white, "Next wave: %4ds", wave_left);
+		font24->printf(   8,  5, Color::white, "Gold: %4d", snap.gold);
+		font24->printf(   7, 22, Color::white, "Lives: %4d", snap.lives);
+		font24->printf(-112,  5, Color::white, "Creep: %4zd", snap.num_creep);
+		font24->printf(-150, 22, Color::white, "Next wave: %4ds", snap.wave_left);
+		backend->render_end();
 	}
-	backend->render_end();
 
 	backend->render_begin(nullptr);
 	{
+		Profiler::Scope scope(profiler, Profiler::RENDER_COMPOSITE);
 		backend->render_target(scene_target, Vector2i(0,0));
 		backend->render_target(ui_target,    Vector2i(0, -ui_height));
 		backend->render_target(info_target,  Vector2i(-info_size.x, -ui_height - info_size.y));
@@ -274,7 +404,7 @@ static void render_game(){
 		/* render ui-outline */
 		const float w = window_size.x;
 		const float h = window_size.y - ui_height;
-		const float s = selected != nullptr ? info_size.y : 0;
+		const float s = snap.find_building(selected) ? info_size.y : 0;
 		Vector2f p[] = {
 			Vector2f(0, h),
 			Vector2f(w - info_size.x, h),
@@ -282,25 +412,348 @@ static void render_game(){
 			Vector2f(w, h - s)
 		};
 		backend->render_lines(Color::white, 3, p, 4);
+
+		if ( show_overview ){
+			render_overview(camera);
+		}
+
+		if ( show_profiler ){
+			render_profiler();
+		}
+
+		backend->render_end();
 	}
-	backend->render_end();
+}
+
+/**
+ * Hash of everything affecting the outcome of the match, used to verify
+ * replays.
+ */
+static uint64_t state_hash(){
+	Fnv1a h;
+	h.add(current_tick);
+	h.add(gold);
+	h.add(lives);
+	h.add(wave_current);
+
+	for ( auto it = creep.begin(); it != creep.end(); ++it ){
+		const Creep* c = *it;
+		h.add(c->world_pos().x);
+		h.add(c->world_pos().y);
+		h.add(c->current_hp());
+		h.add(c->get_region());
+	}
+
+	for ( auto it = building.begin(); it != building.end(); ++it ){
+		const Building* b = *it;
+		h.add(b->grid_pos().x);
+		h.add(b->grid_pos().y);
+		h.add(b->current_level());
+	}
+
+	h.add(projectile.size());
+	return h.value;
+}
+
+static Building* building_at(const Vector2i& grid){
+	for ( auto it = building.begin(); it != building.end(); ++it ){
+		if ( (*it)->grid_pos() == grid ){
+			return *it;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Run a player command, recording it if enabled. Input events are only
+ * recorded.
+ */
+static void execute(const Command& cmd){
+	if ( recorder ){
+		recorder->command(cmd);
+	}
+
+	Building* target;
+	switch ( cmd.type ){
+	case Command::BUILD:
+		Game::build(cmd.pos, (Buildings)cmd.arg);
+		break;
+
+	case Command::UPGRADE:
+		if ( (target = building_at(cmd.pos)) ){
+			target->upgrade();
+		}
+		break;
+
+	case Command::SELL:
+		if ( (target = building_at(cmd.pos)) ){
+			target->sell();
+		}
+		break;
+
+	case Command::BUTTON:
+	case Command::KEY:
+		break;
+	}
+}
+
+/**
+ * Queue a command from input. The simulation executes it at the start of its
+ * next tick, which is also the tick it is recorded with.
+ */
+static void submit(const Command& cmd){
+	std::lock_guard<std::mutex> guard(command_lock);
+	command_queue.push_back(cmd);
+}
+
+/**
+ * Execute commands queued by input since the last tick.
+ */
+static void execute_queued(){
+	{
+		std::lock_guard<std::mutex> guard(command_lock);
+		command_pending.swap(command_queue);
+	}
+
+	for ( auto it = command_pending.begin(); it != command_pending.end(); ++it ){
+		it->tick = current_tick;
+		execute(*it);
+	}
+	command_pending.clear();
+}
+
+/**
+ * Step the simulation forward one tick.
+ */
+static void simulate(float dt){
+	/* spawn wave */
+	wave_left = (int)((next_wave - current_tick + Game::tickrate - 1) / Game::tickrate);
+	if ( current_tick >= next_wave ){
+		wave_current++;
+		next_wave += wave_delay * Game::tickrate;
+
+		fprintf(stderr, "Spawning wave %d\n", wave_current);
+		EntityVector wave = level->spawn(wave_current);
+		std::for_each(wave.begin(), wave.end(), [](Entity* e){ e->set_handle(creep.insert(static_cast<Creep*>(e))); });
+	}
+
+	/* The phases below are split in a parallel part, which only writes state
+	 * owned by the object being updated, followed by a serial merge in pool
+	 * order which applies anything affecting other objects (damage, kills,
+	 * gold, new projectiles). The outcome is thus the same regardless of the
+	 * number of threads. */
+
+	/* update creep */
+	{
+		Profiler::Scope scope(profiler, Profiler::CREEP_UPDATE);
+		Creep::tick_all(*tilemap, *workers, dt);
+	}
+
+	/* find what region each creep is in */
+	{
+		Profiler::Scope scope(profiler, Profiler::REGION_LOOKUP);
+		Creep* const* all = creep.data();
+		const size_t n = creep.dense_size();
+		creep_region.resize(n);
+		workers->parallel_for(n, 512, [all](size_t begin, size_t end){
+			for ( size_t i = begin; i < end; i++ ){
+				if ( !all[i] ) continue;
+				creep_region[i] = tilemap->waypoint_at(all[i]->world_pos(), Vector2f(47,47));
+			}
+		});
+
+		for ( size_t i = 0; i < n; i++ ){
+			Creep* creep = all[i];
+			if ( !creep ) continue; /* removed, possibly by a trigger */
+
+			const Waypoint* region = creep_region[i];
+			const int id = region ? region->id() : -1;
+
+			/* remember current region, done before triggers as they might remove the creep */
+			const int previous = creep->get_region();
+			creep->set_region(id);
+
+			/* creep exited a region */
+			if ( !region && previous != -1 ){
+				creep->on_exit_region(*tilemap->waypoint(previous));
+			}
+
+			/* creep entered a new region */
+			if ( region && previous != id ){
+				creep->on_enter_region(*region);
+			}
+		}
+	}
+
+	/* update towers, creep positions are indexed first for target acquisition */
+	{
+		Profiler::Scope scope(profiler, Profiler::TOWER_TICK);
+		for ( auto it = creep.begin(); it != creep.end(); ++it ){
+			creep_grid.insert(*it, (*it)->world_pos());
+		}
+		creep_grid.build();
+
+		/* targeting reads the creep and writes only the tower */
+		Building* const* all = building.data();
+		const size_t n = building.dense_size();
+		building_target.resize(n);
+		workers->parallel_for(n, 64, [all](size_t begin, size_t end){
+			for ( size_t i = begin; i < end; i++ ){
+				building_target[i] = all[i] ? all[i]->update_target() : NULL;
+			}
+		});
+
+		for ( size_t i = 0; i < n; i++ ){
+			if ( building_target[i] ){
+				all[i]->fire_at(building_target[i]);
+			}
+		}
+	}
+
+	/* update projectiles and resolve hits in the order they were fired */
+	{
+		Profiler::Scope scope(profiler, Profiler::PROJECTILE_UPDATE);
+		const size_t n = projectile.size();
+		projectile_hit.resize(n);
+		projectile_prev.resize(n);
+		workers->parallel_for(n, 512, [dt](size_t begin, size_t end){
+			for ( size_t i = begin; i < end; i++ ){
+				projectile[i].get_points(&projectile_prev[i].first, &projectile_prev[i].second);
+				projectile_hit[i] = projectile[i].tick(dt);
+			}
+		});
+
+		size_t kept = 0;
+		for ( size_t i = 0; i < n; i++ ){
+			if ( projectile_hit[i] ){
+				projectile[i].resolve();
+			} else {
+				projectile_prev[kept] = projectile_prev[i];
+				projectile[kept++] = projectile[i];
+			}
+		}
+		projectile.erase(projectile.begin() + kept, projectile.end());
+		projectile_prev.resize(kept);
+	}
+
+	/* update messages */
+	{
+		Profiler::Scope scope(profiler, Profiler::MESSAGE_UPDATE);
+		auto end = std::remove_if(messages.begin(), messages.end(), [dt](Message* msg) -> bool {
+			if ( msg->tick(dt) ) return false;
+			delete msg;
+			return true;
+		});
+		messages.erase(end, messages.end());
+	}
+
+	/* release everything removed during this tick */
+	creep.collect(Creep::release);
+	building.collect([](Building* building){ delete building; });
+}
+
+/**
+ * Copy what is needed for rendering into a snapshot and hand it over to the
+ * renderer.
+ */
+static void publish(){
+	Snapshot& snap = snapshots.write();
+	snap.tick = current_tick;
+	snap.time = wallclock();
+	snap.gold = gold;
+	snap.lives = lives;
+	snap.wave_left = wave_left;
+
+	snap.entities.clear();
+	for ( auto it = creep.begin(); it != creep.end(); ++it ){
+		const Creep* c = *it;
+		const Handle& handle = c->handle();
+		if ( handle.index >= creep_published.size() ){
+			creep_published.resize(handle.index + 1, std::make_pair(0U, Vector2f()));
+		}
+
+		/* creep in the previous snapshot moves from where it was, new creep
+		 * (including those reusing a slot) appears in place */
+		std::pair<uint32_t, Vector2f>& last = creep_published[handle.index];
+		Snapshot::Entity ent;
+		ent.handle = handle;
+		ent.sprite = c->sprite();
+		ent.pos = c->world_pos();
+		ent.prev = last.first == handle.generation ? last.second : ent.pos;
+		ent.hp = c->current_hp() / c->max_hp();
+		snap.entities.push_back(ent);
+		last = std::make_pair(handle.generation, ent.pos);
+	}
+	snap.num_creep = snap.entities.size();
+
+	snap.buildings.clear();
+	for ( auto it = building.begin(); it != building.end(); ++it ){
+		const Building* b = *it;
+		Snapshot::Entity ent;
+		ent.handle = b->handle();
+		ent.sprite = b->sprite();
+		ent.pos = b->world_pos();
+		ent.prev = ent.pos;
+		ent.hp = b->current_hp() / b->max_hp();
+		snap.entities.push_back(ent);
+
+		Snapshot::Building info;
+		info.handle = b->handle();
+		info.grid = b->grid_pos();
+		info.blueprint = b->get_blueprint();
+		info.level = b->current_level();
+		info.damage = b->damage();
+		info.range = b->range();
+		info.rof = b->rof();
+		info.slow = b->slow();
+		info.slow_duration = b->slow_duration();
+		info.upgrade_cost = b->upgrade_cost();
+		info.sell_cost = b->sell_cost();
+		info.have_slow = b->have_slow();
+		info.can_upgrade = b->can_upgrade();
+		snap.buildings.push_back(info);
+	}
+
+	snap.projectiles.resize(projectile.size());
+	for ( size_t i = 0; i < projectile.size(); i++ ){
+		Snapshot::Projectile& proj = snap.projectiles[i];
+		proj.prev[0] = projectile_prev[i].first;
+		proj.prev[1] = projectile_prev[i].second;
+		projectile[i].get_points(&proj.pos[0], &proj.pos[1]);
+	}
+
+	snap.messages.resize(messages.size());
+	for ( size_t i = 0; i < messages.size(); i++ ){
+		snap.messages[i].pos = messages[i]->pos;
+		snap.messages[i].color = messages[i]->color;
+		snap.messages[i].text = messages[i]->msg;
+	}
+
+	snapshots.publish();
 }
 
 /* build action wrapper function */
 std::function<void(Buildings)> build_action = [](Buildings type){
 	building_selected = type;
 	mode = BUILD;
-	if ( gold < blueprint[building_selected]->cost(1) ){
+	if ( snapshots.read().gold < blueprint[building_selected]->cost(1) ){
 		mode = SELECT;
 	}
 
 	/* drop current entity selection */
-	selected = nullptr;
-	render_info(selected, false, false);
+	selected = Handle();
 };
 
 namespace Game {
-	static void build(const Vector2i& pos, Buildings type);
+	/**
+	 * Bind key to an action, the keypress is recorded (if enabled).
+	 */
+	static void bindkey(const std::string& key, std::function<void()> func){
+		backend->bindkey(key, [key, func](){
+			submit(Command(0, key));
+			func();
+		});
+	}
 
 	void init(const std::string& bn, int w, int h){
 		window_size = Vector2i(w, h);
@@ -312,18 +765,34 @@ namespace Game {
 		}
 
 		backend->init(window_size);
-		backend->bindkey("F1", [](){
+
+		workers = new ThreadPool(num_threads);
+		loader = new Loader(0);
+		fprintf(stderr, "Using %u simulation threads\n", workers->size());
+		fprintf(stderr, "Using %s creep kernel\n", CreepStore::kernel_name());
+		bindkey("F1", [](){
 				show_waypoints = !show_waypoints;
 				fprintf(stderr, "%s waypoints\n", show_waypoints ? "Showing" : "Hiding");
 		});
-		backend->bindkey("F2", [](){
+		bindkey("F2", [](){
 				show_aabb = !show_aabb;
 				fprintf(stderr, "%s AABB\n", show_aabb ? "Showing" : "Hiding");
 		});
+		bindkey("F3", [](){
+				show_profiler = !show_profiler;
+		});
+		bindkey("F4", [](){
+				if ( profiler.dump("profile.csv") ){
+					fprintf(stderr, "Wrote %zd frames to profile.csv\n", profiler.size());
+				}
+		});
+		bindkey("F5", [](){
+				show_overview = !show_overview;
+		});
 
-		backend->bindkey("1", std::bind(build_action, ARROW_TOWER));
-		backend->bindkey("2", std::bind(build_action, ICE_TOWER));
-		backend->bindkey("ESC", [](){
+		bindkey("1", std::bind(build_action, ARROW_TOWER));
+		bindkey("2", std::bind(build_action, ICE_TOWER));
+		bindkey("ESC", [](){
 				mode = SELECT;
 		});
 
@@ -333,140 +802,232 @@ namespace Game {
 		ui_target    = backend->create_rendertarget(Vector2i(window_size.x, ui_height), true);
 		info_target  = backend->create_rendertarget(info_size, true);
 
-		/* load fonts and ui elements */
-		font16 = backend->create_font("calibri_16.bff");
-		font24 = backend->create_font("calibri_24.bff");
-		font34 = backend->create_font("calibri_34.bff");
-		ui_bar_left = backend->create_sprite()->load_texture("bar_left.png")->autoscale();
-		ui_upgrade  = backend->create_sprite()->load_texture("icon_upgrade.png")->autoscale();
-		ui_sell     = backend->create_sprite()->load_texture("icon_sell.png")->autoscale();
+		/* load fonts and ui elements in parallel, textures are uploaded by finish() */
+		loader->run([](){ font16 = backend->create_font("calibri_16.bff"); });
+		loader->run([](){ font24 = backend->create_font("calibri_24.bff"); });
+		loader->run([](){ font34 = backend->create_font("calibri_34.bff"); });
+		loader->run([](){ ui_bar_left = backend->create_sprite()->load_texture("bar_left.png")->autoscale(); });
+		loader->run([](){ ui_upgrade  = backend->create_sprite()->load_texture("icon_upgrade.png")->autoscale(); });
+		loader->run([](){ ui_sell     = backend->create_sprite()->load_texture("icon_sell.png")->autoscale(); });
+		loader->finish();
+	}
+
+	/**
+	 * Release all creep and buildings of the current level along with the
+	 * creep arenas.
+	 */
+	static void unload_level(){
+		for ( auto it = creep.begin(); it != creep.end(); ++it ){
+			creep.remove((*it)->handle());
+		}
+		for ( auto it = building.begin(); it != building.end(); ++it ){
+			building.remove((*it)->handle());
+		}
+		creep.collect(Creep::release);
+		building.collect([](Building* building){ delete building; });
+		Creep::end_waves();
 	}
 
 	void cleanup(){
+		unload_level();
 		backend->cleanup();
 		delete backend;
+		delete workers;
+		workers = nullptr;
+		delete loader;
+		loader = nullptr;
 	}
 
-	void frobnicate(){
-		static const unsigned int framerate = 60;
-		static const uint64_t per_frame = 1000000 / framerate;
-		static const float dt = 1.0f / framerate;
-		running = true;
+	/**
+	 * Simulation thread, runs at tickrate (or as fast as possible when not
+	 * realtime) and publishes a snapshot after each tick.
+	 */
+	static void simulation_loop(){
+		static const uint64_t per_tick = 1000000 / tickrate;
+		static const float dt = 1.0f / tickrate;
 
-		/* for calculating dt */
-		struct timeval t;
-		gettimeofday(&t, NULL);
+		/* wallclock is only used for pacing, never by the simulation itself */
+		uint64_t next_tick = wallclock();
 
-		/* for calculating framerate */
-		struct timeval fref = {t.tv_sec, 0};
-		unsigned int fps = 0;
+		while ( running ){
+			execute_queued();
+
+			if ( lives > 0 ){
+				/* apply recorded commands */
+				Command cmd;
+				while ( playback && playback->next(current_tick, &cmd) ){
+					execute(cmd);
+				}
 
-		/* spawn timer */
-		struct timeval sref = {t.tv_sec + wave_delay, 0};
+				simulate(dt);
+				profiler.add_tick();
+				if ( ++current_tick == tick_limit ){
+					running = false;
+				}
+
+				if ( (recorder || playback) && current_tick % hash_interval == 0 ){
+					const uint64_t hash = state_hash();
+					if ( recorder ) recorder->hash(current_tick, hash);
+					if ( playback && !playback->verify(current_tick, hash) ){
+						running = false;
+					}
+				}
+
+				publish();
+			} else if ( !realtime ){
+				/* nothing more will happen */
+				running = false;
+			}
+
+			/* fixed tickrate */
+			if ( realtime ){
+				next_tick += per_tick;
+				const int64_t delay = next_tick - wallclock();
+				if ( delay > 0 ){
+					usleep(delay);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Poll input and render the latest snapshot until the game ends. Rendering
+	 * is paced by the display (vsync) and never waits for the simulation.
+	 */
+	static void render_loop(){
+		/* when uncapped the rendering is still limited to the tickrate */
+		const uint64_t per_frame = 1000000 / (realtime ? max_framerate : tickrate);
+
+		/* for calculating framerate */
+		uint64_t fref = wallclock();
+		unsigned int frames = 0;
 
 		while ( running ){
-			/* frame update */
-			poll(running); /* byref */
+			const uint64_t begin = wallclock();
+			profiler.begin_frame();
+
+			poll();
+			snapshots.update();
 			render_game();
 
-			if ( lives == 0 ){
-				continue;
+			/* calculate framerate */
+			frames++;
+			if ( begin - fref > 1000000 ){
+				fref += 1000000;
+				fps = frames;
+				frames = 0;
 			}
 
-			struct timeval cur;
-			gettimeofday(&cur, NULL);
+			profiler.end_frame();
 
-			/* calculate framerate */
-			fps++;
-			if ( cur.tv_sec - fref.tv_sec > 1 ){
-				fref.tv_sec++;
-				fps = 0;
+			const int64_t delay = begin + per_frame - wallclock();
+			if ( delay > 0 ){
+				usleep(delay);
 			}
+		}
+	}
+
+	void frobnicate(){
+		running = true;
+
+		std::thread simulation(simulation_loop);
+		render_loop();
+		simulation.join();
+
+		/* input between runs sees the final state */
+		snapshots.update();
+
+		fprintf(stderr, "Simulated %llu ticks (%.1fs): wave %d, %d lives, %d gold\n",
+		        (unsigned long long)current_tick, (float)current_tick / tickrate, wave_current, lives, gold);
 
-			/* spawn wave */
-			wave_left = (sref.tv_sec - cur.tv_sec);
-			if ( wave_left <= 0 ){
-				wave_current++;
-				wave_delay = 15;
-				sref.tv_sec += wave_delay;
+		if ( recorder ){
+			recorder->hash(current_tick, state_hash());
+			recorder->end(current_tick);
+		}
 
-				fprintf(stderr, "Spawning wave %d\n", wave_current);
-				EntityVector wave = level->spawn(wave_current);
-				std::for_each(wave.begin(), wave.end(), [](Entity* e){ creep[e->id()] = static_cast<Creep*>(e); });
+		if ( playback ){
+			const bool diverged = !playback->verify(current_tick, state_hash()) || (playback->end() && current_tick != playback->end());
+			if ( diverged ){
+				fprintf(stderr, "Replay FAILED after %d verified state hashes.\n", playback->verified());
+				exit(1);
 			}
+			fprintf(stderr, "Replay OK, %d state hashes verified.\n", playback->verified());
+		}
+	}
 
-			/* calculate dt */
-			const uint64_t delta = (cur.tv_sec - t.tv_sec) * 1000000 + (cur.tv_usec - t.tv_usec);
-			const  int64_t delay = per_frame - delta;
+	uint64_t tick(){
+		return current_tick;
+	}
 
-			/* update creep */
-			std::for_each(creep.begin(), creep.end(), [](std::pair<const std::string, Creep*>& pair){
-				Creep* creep = pair.second;
-				creep->tick(dt);
+	void set_realtime(bool enabled){
+		realtime = enabled;
+	}
 
-				/* find what region the creep is in */
-				const Waypoint* region = NULL;
-				for ( auto jt = level->waypoints().begin(); jt != level->waypoints().end(); ++jt ){
-					const Waypoint* wp = jt->second;
+	void set_tick_limit(uint64_t ticks){
+		tick_limit = ticks;
+	}
 
-					if ( wp->contains(creep->world_pos(), Vector2f(47,47), true) ){
-						region = wp;
-						break;
-					}
-				}
-				bool found = region;
+	void set_threads(unsigned int n){
+		num_threads = n;
+	}
 
-				/* creep exited a region */
-				if ( !found && creep->get_region() != "" ){
-					creep->on_exit_region(*Game::find_waypoint(creep->get_region()));
-				}
+	void set_seed(uint64_t value){
+		seed = value;
+		seed_set = true;
+	}
 
-				/* creep entered a new region */
-				if ( found && creep->get_region() != region->name() ){
-					creep->on_enter_region(*region);
-				}
+	Random& rng(){
+		return generator;
+	}
 
-				/* remember current region */
-				creep->set_region(region ? region->name() : "");
-			});
-
-			/* update towers */
-			std::for_each(building.begin(), building.end(), [](std::pair<const std::string, Building*>& pair){
-				pair.second->tick(dt);
-			});
-
-			/* update projectiles */
-			auto end = std::remove_if(projectile.begin(), projectile.end(), [](Projectile* proj) -> bool {
-					return proj->tick(dt);
-			});
-			projectile.erase(end, projectile.end());
-
-			/* update messages */
-			std::remove_if(messages.begin(), messages.end(), [](Message* msg){
-				return msg->tick(dt);
-			});
-
-			/* move time forward */
-			t.tv_usec += per_frame;
-			if ( t.tv_usec > 1000000 ){
-				t.tv_usec -= 1000000;
-				t.tv_sec++;
-			}
+	void profile(const std::string& filename){
+		profiler.stream(filename);
+	}
 
-			/* fixed framerate */
-			if ( delay > 0 ){
-				usleep(delay);
-			}
-		}
+	void record(const std::string& filename){
+		record_filename = filename;
+	}
+
+	std::string replay(const std::string& filename){
+		::playback = Replay::from_filename(filename);
+		set_seed(::playback->seed());
+		tick_limit = ::playback->end();
+		realtime = false;
+		return ::playback->level();
 	}
 
 	void load_level(const std::string& filename){
+		unload_level();
+
+		if ( !seed_set ){
+			seed = wallclock();
+		}
+		fprintf(stderr, "Using seed %llu\n", (unsigned long long)seed);
+		generator.reseed(seed);
+
+		if ( !record_filename.empty() ){
+			delete recorder;
+			recorder = new Recorder(record_filename, filename, seed);
+		}
+
+		/* the level and tilemap are parsed on this thread while the tileset
+		 * image and blueprints (including the waves) load in parallel, the
+		 * finish below uploads the tileset and sets the tile size */
 		delete level;
 		level = Level::from_filename(filename);
 
 		/* load all tower blueprints */
-		blueprint[ARROW_TOWER] = Blueprint::from_filename("arrowtower.yaml");
-		blueprint[ICE_TOWER]   = Blueprint::from_filename("icetower.yaml");
+		loader->run([](){ blueprint[ARROW_TOWER] = Blueprint::from_filename("arrowtower.yaml"); });
+		loader->run([](){ blueprint[ICE_TOWER]   = Blueprint::from_filename("icetower.yaml"); });
+		loader->finish();
+
+		/* bucket creep by tile */
+		creep_grid.resize(tilemap->map_width(), tilemap->map_height(),
+		                  Vector2f((float)tilemap->tile_width(), (float)tilemap->tile_height()));
+
+		/* input and rendering only sees the world through snapshots */
+		publish();
+		snapshots.update();
 	}
 
 	Tilemap* load_tilemap(const std::string& filename){
@@ -480,6 +1041,16 @@ namespace Game {
 		return backend->create_sprite(base);
 	}
 
+	void load_async(const std::function<void()>& task){
+		assert(loader);
+		loader->run(task);
+	}
+
+	void defer(const std::function<void()>& task){
+		assert(loader);
+		loader->defer(task);
+	}
+
 	/**
 	 * Takes a position in world-space and clips it to the area defined by the
 	 * tilemap - window. Can be used to prevent user from moving outside of map.
@@ -523,11 +1094,13 @@ namespace Game {
 		int tx = (int)max(world.x / tilemap->tile_width() - 1, 0.0f);
 		int ty = (int)max(world.y / tilemap->tile_height() - 1, 0.0f);
 
-		/** @bug at the far end of the map it will read unallocated memory */
-		cursor_ok[0] = tilemap->at(tx  , ty  ).build;
-		cursor_ok[1] = tilemap->at(tx+1, ty  ).build;
-		cursor_ok[2] = tilemap->at(tx  , ty+1).build;
-		cursor_ok[3] = tilemap->at(tx+1, ty+1).build;
+		{
+			std::lock_guard<std::mutex> guard(tilemap_lock);
+			cursor_ok[0] = tilemap->at(tx  , ty  ).build();
+			cursor_ok[1] = tilemap->at(tx+1, ty  ).build();
+			cursor_ok[2] = tilemap->at(tx  , ty+1).build();
+			cursor_ok[3] = tilemap->at(tx+1, ty+1).build();
+		}
 
 		if ( is_panning ){
 			panning_cur.x = x;
@@ -543,11 +1116,13 @@ namespace Game {
 		}
 
 		/* test if hovering over infobox */
+		const Snapshot::Building* selected = snapshots.read().find_building(::selected);
+		hover_upgrade = false;
+		hover_sell = false;
 		if ( selected && x > window_size.x - info_size.x && y > window_size.y - ui_height - info_size.y ){
 			const Vector2i local((int)x - (window_size.x - info_size.x), (int)y - (window_size.y - ui_height - info_size.y));
-			const bool b1 = local.y >= 161 && local.y < 200 && local.x >= 10  && local.x < 95 && selected->can_upgrade();
-			const bool b2 = local.y >= 161 && local.y < 200 && local.x >= 105 && local.x < 190;
-			render_info(selected, b1, b2);
+			hover_upgrade = local.y >= 161 && local.y < 200 && local.x >= 10  && local.x < 95 && selected->can_upgrade;
+			hover_sell    = local.y >= 161 && local.y < 200 && local.x >= 105 && local.x < 190;
 		}
 	}
 
@@ -560,6 +1135,9 @@ namespace Game {
 			(int)max(world.y / tilemap->tile_height() - 1, 0.0f)
 		);
 
+		const Snapshot::Building* selected = snapshots.read().find_building(::selected);
+		submit(Command(0, Command::BUTTON, Vector2i((int)x, (int)y), button));
+
 		switch ( button ){
 		case 1: /* left button */
 
@@ -578,18 +1156,16 @@ namespace Game {
 			/* test if clicking on infobox */
 			if ( selected && x > window_size.x - info_size.x && y > window_size.y - ui_height - info_size.y ){
 				const Vector2i local((int)x - (window_size.x - info_size.x), (int)y - (window_size.y - ui_height - info_size.y));
-				const bool b1 = local.y >= 161 && local.y < 200 && local.x >= 10  && local.x < 95 && selected->can_upgrade();
+				const bool b1 = local.y >= 161 && local.y < 200 && local.x >= 10  && local.x < 95 && selected->can_upgrade;
 				const bool b2 = local.y >= 161 && local.y < 200 && local.x >= 105 && local.x < 190;
 
 				if ( b1 ){
-					selected->upgrade();
+					submit(Command(0, Command::UPGRADE, selected->grid));
 				}
 				if ( b2 ){
-					selected->sell();
-					selected = nullptr;
+					submit(Command(0, Command::SELL, selected->grid));
+					::selected = Handle();
 				}
-
-				render_info(selected, b1 && selected->can_upgrade(), b2);
 				break;
 			}
 
@@ -600,19 +1176,12 @@ namespace Game {
 					return;
 				}
 
-				build(grid, building_selected);
+				submit(Command(0, Command::BUILD, grid, building_selected));
 				motion(x, y); /* to update marker */
 				mode = SELECT;
 			} else if ( mode == SELECT ){
-				selected = nullptr;
-				for ( auto it = building.begin(); it != building.end(); ++it ){
-					Building* building = it->second;
-					if ( building->grid_pos() == grid ){
-						selected = building;
-						break;
-					}
-				}
-				render_info(selected, false, false);
+				const Snapshot::Building* found = snapshots.read().building_at(grid);
+				::selected = found ? found->handle : Handle();
 			}
 			break;
 
@@ -655,6 +1224,18 @@ namespace Game {
 	}
 
 	static void build(const Vector2i& pos, Buildings type){
+		if ( type < 0 || type >= BUILDING_LAST ){
+			return;
+		}
+
+		/* input only checks the tiles as they were when queuing the command,
+		 * another building might have been placed since */
+		for ( int y = 0; y < 2; y++ ){
+			for ( int x = 0; x < 2; x++ ){
+				if ( !tilemap->at(pos.x + x, pos.y + y).build() ) return;
+			}
+		}
+
 		const int cost = blueprint[type]->cost(1);
 		if ( !transaction(cost, Vector2f(pos.x*tile_width(), pos.y*tile_height())) ){
 			fprintf(stderr, "Not enough gold, cost %d have %d\n", cost, gold);
@@ -662,8 +1243,15 @@ namespace Game {
 		}
 
 		Building* tmp = Building::place_at_tile(pos, blueprint[type]);
-		building[tmp->id()] = tmp;
-		tilemap->reserve(pos, Vector2i(2,2));
+		tmp->set_handle(building.insert(tmp));
+
+		{
+			std::lock_guard<std::mutex> guard(tilemap_lock);
+			tilemap->reserve(pos, Vector2i(2,2));
+		}
+
+		/* the repair only reads tiles so rendering is not held up by it */
+		tilemap->reroute(pos, Vector2i(2,2), true);
 	}
 
 	size_t tile_width(){
@@ -687,52 +1275,41 @@ namespace Game {
 		}
 	}
 
-	Entity* find_entity(const std::string& name){
-		/* hack to determine if it is building or creep */
-		const bool is_creep = name[0] == 'c';
+	Creep* find_creep(const Handle& handle){
+		return creep.get(handle);
+	}
 
-		if ( is_creep ){
-			auto it = creep.find(name);
-			if ( it != creep.end() ){
-				return it->second;
-			} else {
-				return NULL;
-			}
-		} else {
-			auto it = building.find(name);
-			if ( it != building.end() ){
-				return it->second;
-			} else {
-				return NULL;
-			}
-		}
+	Building* find_building(const Handle& handle){
+		return building.get(handle);
+	}
+
+	void remove_creep(const Handle& handle){
+		creep.remove(handle);
 	}
 
-	void remove_entity(const std::string& name){
-		Entity* ent = find_entity(name);
+	void remove_building(const Handle& handle){
+		Building* ent = building.get(handle);
 		if ( !ent ){
 			return;
 		}
 
-		/* hack to determine if it is building or creep */
-		const bool is_creep = name[0] == 'c';
-
-		if ( is_creep ){
-			creep.erase(name);
-		} else {
+		{
+			std::lock_guard<std::mutex> guard(tilemap_lock);
 			tilemap->unreserve(ent->grid_pos(), Vector2i(2,2));
-			building.erase(name);
 		}
+		tilemap->reroute(ent->grid_pos(), Vector2i(2,2), false);
+		building.remove(handle);
+	}
 
-		/* release resources */
-		ent->dec_ref();
+	Creep* nearest_creep(const Vector2f& pos, float range){
+		return creep_grid.nearest(pos, range);
 	}
 
-	const std::map<std::string, Creep*>& all_creep(){
+	const Pool<Creep>& all_creep(){
 		return ::creep;
 	}
 
-	void add_projectile(Projectile* proj){
+	void add_projectile(const Projectile& proj){
 		projectile.push_back(proj);
 	}
 
@@ -1,9 +1,11 @@
 #ifndef DVB021_GAME_H
 #define DVB021_GAME_H
 
+#include "pool.hpp"
 #include "projectile.hpp"
 #include "vector.hpp"
 #include <cstddef>
+#include <stdint.h>
 #include <string>
 #include <map>
 #include <functional>
@@ -34,6 +36,18 @@ namespace Game {
 	 */
 	Sprite* create_sprite(const Sprite* base = NULL);
 
+	/**
+	 * Run part of loading on a loader thread. Must be called while loading
+	 * (from init or load_level), which waits for it to finish.
+	 */
+	void load_async(const std::function<void()>& task);
+
+	/**
+	 * Run task on the main thread once loading is done with it, e.g. uploading
+	 * a texture decoded on a loader thread. May be called from any thread.
+	 */
+	void defer(const std::function<void()>& task);
+
 	/**
 	 * Find waypoint by name.
 	 * @return Waypoint or NULL if no such waypoint could be found.
@@ -41,22 +55,33 @@ namespace Game {
 	const Waypoint* find_waypoint(const std::string& name);
 
 	/**
-	 * Find entity by id.
-	 * @return Entity or NULL if no such entity was found.
+	 * Find creep by handle.
+	 * @return Creep or NULL if it no longer exists.
+	 */
+	Creep* find_creep(const Handle& handle);
+
+	/**
+	 * Find building by handle.
+	 * @return Building or NULL if it no longer exists.
+	 */
+	Building* find_building(const Handle& handle);
+
+	/**
+	 * Remove creep from world. Memory is released at the end of the tick.
+	 * No-op if the creep is already removed.
 	 */
-	Entity* find_entity(const std::string& name);
+	void remove_creep(const Handle& handle);
 
 	/**
-	 * Remove entity by id.
-	 * No-op if entity no such entity was found.
+	 * Remove building from world. Memory is released at the end of the tick.
+	 * No-op if the building is already removed.
 	 */
-	void remove_entity(const std::string& name);
+	void remove_building(const Handle& handle);
 
 	/**
-	 * Add projectile to world.
-	 * @param proj New projectile instance, takes ownership of pointer.
+	 * Add projectile to world (copied).
 	 */
-	void add_projectile(Projectile* proj);
+	void add_projectile(const Projectile& proj);
 
 	/**
 	 * Gold transaction.
@@ -69,16 +94,84 @@ namespace Game {
 	 */
 	void mutilate();
 
+	/**
+	 * Find the creep closest to pos within range, ties are broken by spawn
+	 * order. Only sees creep positions as of the last creep update.
+	 * @return Creep or NULL if no creep is in range.
+	 */
+	Creep* nearest_creep(const Vector2f& pos, float range);
+
 	/**
 	 * All creep.
 	 */
-	const std::map<std::string, Creep*>& all_creep();
+	const Pool<Creep>& all_creep();
 
 	/**
-	 * Do stuff.
+	 * Do stuff. The simulation runs on a thread of its own while the calling
+	 * thread polls input and renders, until quit or the tick limit.
 	 */
 	void frobnicate();
 
+	/**
+	 * Simulation ticks per second.
+	 */
+	const unsigned int tickrate = 60;
+
+	/**
+	 * Number of ticks simulated so far. All gameplay timing is based on this
+	 * instead of wallclock so results does not depend on the framerate.
+	 */
+	uint64_t FROB_PURE tick();
+
+	/**
+	 * If enabled (default) the simulation is paced to run at tickrate,
+	 * otherwise it is stepped as fast as possible and stops at game over.
+	 */
+	void set_realtime(bool enabled);
+
+	/**
+	 * Stop after the given number of ticks has been simulated.
+	 * @param ticks 0 runs forever.
+	 */
+	void set_tick_limit(uint64_t ticks);
+
+	/**
+	 * Number of threads used to update the simulation, 0 (default) uses one
+	 * per core. The outcome does not depend on it. Must be set before init.
+	 */
+	void set_threads(unsigned int n);
+
+	/**
+	 * Seed used for the next level, if not set a seed is picked based on the
+	 * current time.
+	 */
+	void set_seed(uint64_t seed);
+
+	/**
+	 * Per-match random number generator, reseeded when a level is loaded. All
+	 * randomness affecting gameplay must come from this generator.
+	 */
+	Random& rng();
+
+	/**
+	 * Write the phase timings of every frame to a CSV file. The most recent
+	 * frames can also be shown (F3) or dumped (F4) while running.
+	 */
+	void profile(const std::string& filename);
+
+	/**
+	 * Record the match to file (must be called before loading the level).
+	 */
+	void record(const std::string& filename);
+
+	/**
+	 * Replay a recorded match instead of taking gameplay commands from the
+	 * player. State hashes are verified against the recording and the process
+	 * exits with an error if they differ.
+	 * @return Filename of the level to load.
+	 */
+	std::string replay(const std::string& filename);
+
 	/**
 	 * Get the width of a tile. Static per level.
 	 */
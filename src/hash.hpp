@@ -0,0 +1,32 @@
+#ifndef FROBNICATOR_HASH_H
+#define FROBNICATOR_HASH_H
+
+#include <stdint.h>
+#include <cstddef>
+
+/**
+ * Incremental 64-bit FNV-1a hash, used for replay state hashes and to detect
+ * changed blueprint sources.
+ */
+class Fnv1a {
+public:
+	Fnv1a()
+		: value(14695981039346656037ULL) {}
+
+	void add(const void* data, size_t size){
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for ( size_t i = 0; i < size; i++ ){
+			value ^= p[i];
+			value *= 1099511628211ULL;
+		}
+	}
+
+	template <class T>
+	void add(const T& v){
+		add(&v, sizeof(T));
+	}
+
+	uint64_t value;
+};
+
+#endif /* FROBNICATOR_HASH_H */
@@ -0,0 +1,179 @@
+#ifndef FROBNICATOR_KEYWORD_H
+#define FROBNICATOR_KEYWORD_H
+
+#include "scalar_view.hpp"
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * Keys known by the YAML loaders. Keys are looked up through a perfect hash
+ * generated at compile time: each keyword is hashed (FNV-1a) into its own
+ * slot of a small table so a lookup is one hash, one load and one compare.
+ * Loaders switch on the result instead of comparing strings one at a time.
+ *
+ * To add a keyword add it to both Id and names (in the same order). If the
+ * static_assert below fires the new keyword collides with another, pick a
+ * new seed (any odd number which passes).
+ */
+namespace Keyword {
+	enum Id {
+		UNKNOWN,
+		AMOUNT,
+		ARMOR,
+		BUILD,
+		COST,
+		DAMAGE,
+		DATA,
+		DEFAULT,
+		H,
+		HEIGHT,
+		HP,
+		ICON,
+		INNER,
+		LEVEL,
+		META,
+		NAME,
+		NEXT,
+		OFFSET,
+		POISON,
+		POISON_DURATION,
+		RANGE,
+		ROF,
+		SCALE,
+		SLOTS,
+		SLOW,
+		SLOW_DURATION,
+		SPAWN,
+		SPEED,
+		SPLASH,
+		SPRITE,
+		TEXTURE,
+		TILEMAP,
+		TILES_HORIZONTAL,
+		TILES_VERTICAL,
+		TITLE,
+		W,
+		WAVES,
+		WAYPOINT,
+		WIDTH,
+		X,
+		Y,
+
+		KEYWORD_LAST,
+	};
+
+	namespace detail {
+		constexpr const char* names[KEYWORD_LAST] = {
+			"",
+			"amount",
+			"armor",
+			"build",
+			"cost",
+			"damage",
+			"data",
+			"default",
+			"h",
+			"height",
+			"hp",
+			"icon",
+			"inner",
+			"level",
+			"meta",
+			"name",
+			"next",
+			"offset",
+			"poison",
+			"poison_duration",
+			"range",
+			"rof",
+			"scale",
+			"slots",
+			"slow",
+			"slow_duration",
+			"spawn",
+			"speed",
+			"splash",
+			"sprite",
+			"texture",
+			"tilemap",
+			"tiles_horizontal",
+			"tiles_vertical",
+			"title",
+			"w",
+			"waves",
+			"waypoint",
+			"width",
+			"x",
+			"y",
+		};
+
+		static const unsigned int bits = 7;      /* table has 2^bits slots */
+		static const uint32_t seed = 8337;
+
+		constexpr size_t length(const char* str){
+			return *str ? 1 + length(str + 1) : 0;
+		}
+
+		constexpr uint32_t hash(const char* str, size_t len, uint32_t h = 2166136261u){
+			return len == 0 ? h : hash(str + 1, len - 1, (h ^ (uint8_t)*str) * 16777619u);
+		}
+
+		constexpr uint32_t slot(uint32_t h){
+			return (h * seed) >> (32 - bits);
+		}
+
+		constexpr uint32_t slot_of(int id){
+			return slot(hash(names[id], length(names[id])));
+		}
+
+		/* keyword occupying a slot */
+		constexpr uint8_t id_at(uint32_t s, int id = UNKNOWN + 1){
+			return id == KEYWORD_LAST ? UNKNOWN : slot_of(id) == s ? id : id_at(s, id + 1);
+		}
+
+		/* true if every keyword got a slot of its own */
+		constexpr bool perfect(int id = UNKNOWN + 1){
+			return id == KEYWORD_LAST || (id_at(slot_of(id)) == id && perfect(id + 1));
+		}
+
+		static_assert(perfect(), "keyword hash collision, change Keyword::detail::seed");
+
+		template <unsigned int... S>
+		struct Table {
+			static const uint8_t id[sizeof...(S)];
+			static const uint8_t length[sizeof...(S)]; /* of the keyword in each slot */
+		};
+
+		template <unsigned int... S>
+		const uint8_t Table<S...>::id[sizeof...(S)] = { id_at(S)... };
+
+		template <unsigned int... S>
+		const uint8_t Table<S...>::length[sizeof...(S)] = { detail::length(names[id_at(S)])... };
+
+		template <unsigned int N, unsigned int... S>
+		struct MakeTable: MakeTable<N - 1, N - 1, S...> {};
+
+		template <unsigned int... S>
+		struct MakeTable<0, S...> {
+			typedef Table<S...> type;
+		};
+
+		typedef MakeTable<1u << bits>::type table;
+	}
+
+	inline Id lookup(const char* str, size_t len){
+		using namespace detail;
+		const uint32_t s = slot(hash(str, len));
+		const uint8_t id = table::id[s];
+
+		/* lengths first, the key may contain NUL */
+		return id != UNKNOWN && table::length[s] == len && memcmp(names[id], str, len) == 0 ? Id(id) : UNKNOWN;
+	}
+
+	inline Id lookup(const ScalarView& key){
+		return lookup(key.data(), key.size());
+	}
+}
+
+#endif /* FROBNICATOR_KEYWORD_H */
@@ -9,6 +9,7 @@
 #include "tilemap.hpp"
 #include "entity.hpp"
 #include "common.hpp"
+#include "keyword.hpp"
 #include <yaml.h>
 #include <cassert>
 #include <algorithm>
@@ -20,7 +21,8 @@
 class LevelPimpl {
 public:
 	LevelPimpl(const std::string& filename)
-		: title("untitled level")
+		: waves(NULL)
+		, title("untitled level")
 		, tilemap(NULL) {
 
 		const char* real_filename = real_path(filename.c_str());
@@ -58,6 +60,7 @@ public:
 
 		const size_t amount = waves->amount(level);
 		auto tmp = std::vector<Entity*>(amount * tilemap->spawnpoints().size());
+		Creep::begin_wave(tmp.size());
 
 		auto pos = tmp.begin();
 		for ( auto it = tilemap->spawnpoints().begin(); it != tilemap->spawnpoints().end(); ++it ){
@@ -65,8 +68,8 @@ public:
 
 			const Waypoint* dst = Game::find_waypoint(spawn->next);
 			std::generate(pos, pos+amount, [this, level, spawn, dst](){
-					Creep* creep = Creep::spawn_at(spawn->random_point(Vector2i(48,48)), waves, level);
-					if ( dst ){ creep->set_dst(dst->middle()); }
+					Creep* creep = Creep::spawn_at(spawn->random_point(Game::rng(), Vector2i(48,48)), waves, level);
+					creep->set_goal(dst);
 					return creep;
 			});
 			pos += amount;
@@ -114,24 +117,25 @@ private:
 				abort();
 			}
 
-			const char* key = (const char*)ekey.data.scalar.value;
-			const size_t len = ekey.data.scalar.length;
+			const ScalarView key(ekey);
 
 			/* Parse value */
 			yaml_parser_parse(parser, &evalue) || yaml_error(parser);
-			const char* value = (const char*)evalue.data.scalar.value;
-			const size_t value_len = evalue.data.scalar.length;
+			const ScalarView value(evalue);
 
 			/* Fill level with info */
-			if ( strncmp("title", key, len) == 0 ){
-				title = std::string(value, value_len);
-			} else if ( strncmp("tilemap", key, len) == 0 ){
-				tilemap = Game::load_tilemap(std::string(value, value_len));
-			} else if ( strncmp("waves", key, len) == 0 ){
-				waves = Blueprint::from_filename(std::string(value, value_len));
-			} else {
+			switch ( Keyword::lookup(key) ){
+			case Keyword::TITLE:   title = value.str(); break;
+			case Keyword::TILEMAP: tilemap = Game::load_tilemap(value.str()); break;
+			case Keyword::WAVES: {
+				/* parsed in the background, Game::load_level waits for it */
+				const std::string name = value.str();
+				Game::load_async([this, name](){ waves = Blueprint::from_filename(name); });
+				break;
+			}
+			default:
 				/* warning only */
-				fprintf(stderr, "Unhandled key `%.*s'\n", (int)len, key);
+				fprintf(stderr, "Unhandled key `%.*s'\n", (int)key.size(), key.data());
 			}
 		} while ( true );
 	}
@@ -0,0 +1,84 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "loader.hpp"
+#include <algorithm>
+
+Loader::Loader(unsigned int threads)
+	: running(0)
+	, stopping(false) {
+
+	if ( threads == 0 ){
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+
+	for ( unsigned int i = 0; i < threads; i++ ){
+		thread.push_back(std::thread(&Loader::worker, this));
+	}
+}
+
+Loader::~Loader(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for ( auto it = thread.begin(); it != thread.end(); ++it ){
+		it->join();
+	}
+}
+
+void Loader::run(const Task& task){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queued.push_back(task);
+	}
+	wake.notify_one();
+}
+
+void Loader::defer(const Task& task){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		deferred.push_back(task);
+	}
+	progress.notify_all();
+}
+
+void Loader::finish(){
+	std::unique_lock<std::mutex> guard(lock);
+	do {
+		progress.wait(guard, [this](){
+			return !deferred.empty() || (queued.empty() && running == 0);
+		});
+
+		/* run outside the lock so workers can keep deferring */
+		while ( !deferred.empty() ){
+			Task task = deferred.front();
+			deferred.pop_front();
+			guard.unlock();
+			task();
+			guard.lock();
+		}
+	} while ( !queued.empty() || running > 0 );
+}
+
+void Loader::worker(){
+	std::unique_lock<std::mutex> guard(lock);
+	while ( true ){
+		wake.wait(guard, [this](){ return stopping || !queued.empty(); });
+		if ( queued.empty() ) return; /* stopping */
+
+		Task task = queued.front();
+		queued.pop_front();
+		running++;
+
+		guard.unlock();
+		task();
+		guard.lock();
+
+		running--;
+		progress.notify_all();
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef FROBNICATOR_LOADER_H
+#define FROBNICATOR_LOADER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Worker threads for loading assets: reading files, decoding images and
+ * parsing YAML.
+ *
+ * Anything touching GL must happen on the main thread, so workers hand such
+ * steps (e.g. uploading a decoded image) back with defer(). finish() runs
+ * them on the main thread as they arrive, so uploads overlap with decoding
+ * still in progress.
+ */
+class Loader {
+public:
+	typedef std::function<void()> Task;
+
+	/**
+	 * @param threads Number of worker threads, 0 uses the number of cores.
+	 */
+	explicit Loader(unsigned int threads);
+	~Loader();
+
+	/**
+	 * Run task on a worker thread.
+	 */
+	void run(const Task& task);
+
+	/**
+	 * Queue task for the main thread, it is run by the next finish(). May be
+	 * called from any thread.
+	 */
+	void defer(const Task& task);
+
+	/**
+	 * Wait for all tasks given to run() and run deferred tasks meanwhile.
+	 * Must be called from the main thread.
+	 */
+	void finish();
+
+	unsigned int size() const { return thread.size(); }
+
+private:
+	void worker();
+
+	std::vector<std::thread> thread;
+	std::mutex lock;
+	std::condition_variable wake;     /* new task or stopping */
+	std::condition_variable progress; /* task finished or deferred */
+	std::deque<Task> queued;
+	std::deque<Task> deferred;
+	size_t running;                   /* tasks taken by workers but not finished */
+	bool stopping;
+};
+
+#endif /* FROBNICATOR_LOADER_H */
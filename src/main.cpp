@@ -2,18 +2,109 @@
 #include "config.h"
 #endif
 
+#include "backend.hpp"
 #include "game.hpp"
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
+static void usage(const char* program){
+	fprintf(stderr, "usage: %s [OPTIONS] [LEVEL]\n", program);
+	fprintf(stderr, "  --backend NAME    Backend to use (default: SDLBackend)\n");
+	fprintf(stderr, "  --uncapped        Step simulation as fast as possible\n");
+	fprintf(stderr, "  --ticks N         Stop after N simulation ticks (%d per second)\n", Game::tickrate);
+	fprintf(stderr, "  --seed N          Seed for the match (default: current time)\n");
+	fprintf(stderr, "  --record FILE     Record match to FILE\n");
+	fprintf(stderr, "  --replay FILE     Replay and verify a recorded match (default backend: NullBackend)\n");
+	fprintf(stderr, "  --profile FILE    Write per-frame phase timings to FILE (CSV)\n");
+	fprintf(stderr, "  --threads N       Simulation threads (default: one per core)\n");
+	fprintf(stderr, "  --help            Show this text\n");
+
+	fprintf(stderr, "\navailable backends:\n");
+	const std::vector<std::string> backends = Backend::available();
+	for ( auto it = backends.begin(); it != backends.end(); ++it ){
+		fprintf(stderr, "  %s\n", it->c_str());
+	}
+}
+
 int main(int argc, const char* argv[]){
 	std::string filename = "maul.level";
+	std::string backend = "SDLBackend";
+	std::string replay;
+	bool have_backend = false;
+
+	for ( int i = 1; i < argc; i++ ){
+		const char* arg = argv[i];
+
+		if ( strcmp(arg, "--backend") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--backend' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			backend = argv[i];
+			have_backend = true;
+		} else if ( strncmp(arg, "--backend=", 10) == 0 ){
+			backend = arg + 10;
+			have_backend = true;
+		} else if ( strcmp(arg, "--uncapped") == 0 ){
+			Game::set_realtime(false);
+		} else if ( strcmp(arg, "--ticks") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--ticks' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			Game::set_tick_limit(strtoull(argv[i], NULL, 10));
+		} else if ( strcmp(arg, "--seed") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--seed' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			Game::set_seed(strtoull(argv[i], NULL, 10));
+		} else if ( strcmp(arg, "--record") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--record' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			Game::record(argv[i]);
+		} else if ( strcmp(arg, "--replay") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--replay' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			replay = argv[i];
+		} else if ( strcmp(arg, "--profile") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--profile' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			Game::profile(argv[i]);
+		} else if ( strcmp(arg, "--threads") == 0 ){
+			if ( ++i == argc ){
+				fprintf(stderr, "%s: option `--threads' requires an argument\n", argv[0]);
+				exit(1);
+			}
+			Game::set_threads(strtoul(argv[i], NULL, 10));
+		} else if ( strcmp(arg, "--help") == 0 ){
+			usage(argv[0]);
+			exit(0);
+		} else if ( arg[0] == '-' ){
+			fprintf(stderr, "%s: unrecognized option `%s'\n", argv[0], arg);
+			usage(argv[0]);
+			exit(1);
+		} else {
+			filename = arg;
+		}
+	}
 
-	if ( argc >= 2 ){
-		filename = argv[1];
+	/* replays runs headless unless a backend is explicitly requested */
+	if ( !replay.empty() ){
+		filename = Game::replay(replay);
+		if ( !have_backend ){
+			backend = "NullBackend";
+		}
 	}
 
-	Game::init("SDLBackend", 800, 600);
+	Game::init(backend, 800, 600);
 	Game::load_level(filename);
 	Game::frobnicate();
 	Game::cleanup();
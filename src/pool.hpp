@@ -0,0 +1,221 @@
+#ifndef FROBNICATOR_POOL_H
+#define FROBNICATOR_POOL_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/**
+ * Reference to an object stored in a Pool. Lookups using a handle to an
+ * object that has since been removed returns NULL, even if the slot has been
+ * reused.
+ */
+class Handle {
+public:
+	Handle()
+		: index(0)
+		, generation(0) {}
+
+	Handle(uint32_t index, uint32_t generation)
+		: index(index)
+		, generation(generation) {}
+
+	bool operator==(const Handle& rhs) const {
+		return index == rhs.index && generation == rhs.generation;
+	}
+
+	bool operator!=(const Handle& rhs) const {
+		return !(*this == rhs);
+	}
+
+	/**
+	 * False for default constructed handles. Note that it does not tell if the
+	 * object still exists, use Pool::get for that.
+	 */
+	bool valid() const {
+		return generation != 0;
+	}
+
+	uint32_t index;
+	uint32_t generation;
+};
+
+/**
+ * Dense storage of objects with O(1) lookup by handle.
+ *
+ * Objects are iterated in insertion order from a contiguous array. Removal is
+ * deferred: a removed object is immediately unreachable by handle and skipped
+ * by iteration but it is not released until collect() is called, so objects
+ * can safely be removed while the pool is being iterated. Inserting while
+ * iterating is not allowed.
+ */
+template <class T>
+class Pool {
+public:
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T* value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T* const* pointer;
+		typedef T* const& reference;
+
+		iterator(T* const* cur, T* const* end)
+			: cur(cur)
+			, end(end) {
+			skip();
+		}
+
+		reference operator*() const { return *cur; }
+		iterator& operator++(){ ++cur; skip(); return *this; }
+		iterator operator++(int){ iterator tmp = *this; ++*this; return tmp; }
+		bool operator==(const iterator& rhs) const { return cur == rhs.cur; }
+		bool operator!=(const iterator& rhs) const { return cur != rhs.cur; }
+
+	private:
+		/* removed objects are left as NULL until collected */
+		void skip(){
+			while ( cur != end && !*cur ) ++cur;
+		}
+
+		T* const* cur;
+		T* const* end;
+	};
+
+	Pool()
+		: live(0) {}
+
+	/**
+	 * Add object to pool.
+	 * @return Handle to the object.
+	 */
+	Handle insert(T* obj){
+		uint32_t index;
+		if ( !free.empty() ){
+			index = free.back();
+			free.pop_back();
+		} else {
+			index = slot.size();
+			slot.push_back(Slot());
+		}
+
+		slot[index].dense = dense.size();
+		dense.push_back(obj);
+		owner.push_back(index);
+		live++;
+
+		return Handle(index, slot[index].generation);
+	}
+
+	/**
+	 * Get object by handle.
+	 * @return Object or NULL if it has been removed.
+	 */
+	T* get(const Handle& handle) const {
+		if ( handle.index >= slot.size() ) return NULL;
+		const Slot& s = slot[handle.index];
+		if ( s.generation != handle.generation ) return NULL;
+		return dense[s.dense];
+	}
+
+	/**
+	 * Remove object by handle. The object is released on next collect().
+	 * @return false if it was already removed.
+	 */
+	bool remove(const Handle& handle){
+		T* obj = get(handle);
+		if ( !obj ) return false;
+
+		Slot& s = slot[handle.index];
+		dense[s.dense] = NULL;
+		pending.push_back(std::make_pair(obj, handle.index));
+		live--;
+
+		/* invalidate all existing handles to this slot (0 is reserved for invalid handles) */
+		if ( ++s.generation == 0 ){
+			s.generation = 1;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Compact storage and release all removed objects. Must not be called
+	 * while iterating.
+	 * @param release Called once for each removed object.
+	 */
+	template <typename F>
+	void collect(F release){
+		if ( pending.empty() ) return;
+
+		/* stable compaction to retain insertion order */
+		size_t n = 0;
+		for ( size_t i = 0; i < dense.size(); i++ ){
+			if ( !dense[i] ) continue;
+			dense[n] = dense[i];
+			owner[n] = owner[i];
+			slot[owner[n]].dense = n;
+			n++;
+		}
+		dense.resize(n);
+		owner.resize(n);
+
+		/* slots can only be reused once the objects are released */
+		for ( auto it = pending.begin(); it != pending.end(); ++it ){
+			release(it->first);
+			free.push_back(it->second);
+		}
+		pending.clear();
+	}
+
+	/**
+	 * Number of objects (not counting removed objects).
+	 */
+	size_t size() const {
+		return live;
+	}
+
+	/**
+	 * Dense array of objects in iteration order, removed objects are NULL.
+	 * Allows splitting the objects into ranges, e.g. for parallel updates.
+	 */
+	T* const* data() const {
+		return dense.data();
+	}
+
+	/**
+	 * Length of the dense array (including removed objects).
+	 */
+	size_t dense_size() const {
+		return dense.size();
+	}
+
+	iterator begin() const {
+		return iterator(dense.data(), dense.data() + dense.size());
+	}
+
+	iterator end() const {
+		return iterator(dense.data() + dense.size(), dense.data() + dense.size());
+	}
+
+private:
+	struct Slot {
+		Slot()
+			: generation(1)
+			, dense(0) {}
+
+		uint32_t generation;
+		uint32_t dense;      /* index into dense array */
+	};
+
+	std::vector<Slot> slot;
+	std::vector<T*> dense;
+	std::vector<uint32_t> owner;   /* dense index to slot index */
+	std::vector<uint32_t> free;    /* slots available for reuse */
+	std::vector<std::pair<T*, uint32_t> > pending; /* removed but not yet released (object, slot) */
+	size_t live;
+};
+
+#endif /* FROBNICATOR_POOL_H */
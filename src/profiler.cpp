@@ -0,0 +1,137 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "profiler.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+static const char* phase_name[Profiler::PHASE_LAST] = {
+	"poll",
+	"render_scene",
+	"render_ui",
+	"render_composite",
+	"creep_update",
+	"region_lookup",
+	"tower_tick",
+	"projectile_update",
+	"message_update",
+};
+
+Profiler::Profiler()
+	: frame_start(0)
+	, head(0)
+	, count(0)
+	, output(NULL) {
+
+	memset(frames, 0, sizeof(frames));
+	memset(&current, 0, sizeof(current));
+}
+
+Profiler::~Profiler(){
+	if ( output ){
+		fclose(output);
+	}
+}
+
+uint64_t Profiler::now(){
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+const char* Profiler::name(Phase phase){
+	return phase_name[phase];
+}
+
+void Profiler::begin_frame(){
+	std::lock_guard<std::mutex> guard(lock);
+	memset(&current, 0, sizeof(current));
+	frame_start = now();
+}
+
+void Profiler::end_frame(){
+	std::lock_guard<std::mutex> guard(lock);
+	current.total = now() - frame_start;
+	frames[head] = current;
+	head = (head + 1) % history;
+	if ( count < history ) count++;
+
+	if ( output ){
+		write_frame(output, current);
+	}
+}
+
+const Profiler::Frame& Profiler::frame(size_t age) const {
+	return frames[(head + history - 1 - age) % history];
+}
+
+void Profiler::summary(Frame* avg, Frame* max) const {
+	std::lock_guard<std::mutex> guard(lock);
+	memset(avg, 0, sizeof(Frame));
+	memset(max, 0, sizeof(Frame));
+	if ( count == 0 ) return;
+
+	for ( size_t i = 0; i < count; i++ ){
+		const Frame& f = frame(i);
+		for ( int p = 0; p < PHASE_LAST; p++ ){
+			avg->phase[p] += f.phase[p];
+			if ( f.phase[p] > max->phase[p] ) max->phase[p] = f.phase[p];
+		}
+		avg->total += f.total;
+		avg->ticks += f.ticks;
+		if ( f.total > max->total ) max->total = f.total;
+		if ( f.ticks > max->ticks ) max->ticks = f.ticks;
+	}
+
+	for ( int p = 0; p < PHASE_LAST; p++ ){
+		avg->phase[p] /= count;
+	}
+	avg->total /= count;
+	avg->ticks /= count;
+}
+
+void Profiler::write_header(FILE* fp){
+	for ( int p = 0; p < PHASE_LAST; p++ ){
+		fprintf(fp, "%s_us,", phase_name[p]);
+	}
+	fprintf(fp, "total_us,ticks\n");
+}
+
+void Profiler::write_frame(FILE* fp, const Frame& frame){
+	for ( int p = 0; p < PHASE_LAST; p++ ){
+		fprintf(fp, "%.1f,", frame.phase[p] / 1000.0);
+	}
+	fprintf(fp, "%.1f,%u\n", frame.total / 1000.0, frame.ticks);
+}
+
+bool Profiler::dump(const std::string& filename) const {
+	FILE* fp = fopen(filename.c_str(), "w");
+	if ( !fp ){
+		fprintf(stderr, "Failed to open `%s' for writing.\n", filename.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	write_header(fp);
+	for ( size_t i = count; i > 0; i-- ){
+		write_frame(fp, frame(i - 1));
+	}
+
+	fclose(fp);
+	return true;
+}
+
+void Profiler::stream(const std::string& filename){
+	if ( output ){
+		fclose(output);
+	}
+
+	output = fopen(filename.c_str(), "w");
+	if ( !output ){
+		fprintf(stderr, "Failed to open `%s' for writing.\n", filename.c_str());
+		exit(1);
+	}
+
+	write_header(output);
+}
@@ -0,0 +1,137 @@
+#ifndef FROBNICATOR_PROFILER_H
+#define FROBNICATOR_PROFILER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Measures how long each phase of a frame takes. Timings are accumulated per
+ * rendered frame (during which any number of simulation ticks may run) and the
+ * most recent frames are kept in a ring buffer. Frames are begun and ended by
+ * the render thread while the simulation thread adds its phases and ticks to
+ * whichever frame is current.
+ *
+ * Use Profiler::Scope to time a block:
+ *
+ *   {
+ *     Profiler::Scope scope(profiler, Profiler::POLL);
+ *     ...
+ *   }
+ */
+class Profiler {
+public:
+	enum Phase {
+		POLL,
+		RENDER_SCENE,
+		RENDER_UI,
+		RENDER_COMPOSITE,
+		CREEP_UPDATE,
+		REGION_LOOKUP,
+		TOWER_TICK,
+		PROJECTILE_UPDATE,
+		MESSAGE_UPDATE,
+
+		PHASE_LAST,
+	};
+
+	struct Frame {
+		uint64_t phase[PHASE_LAST]; /* nanoseconds */
+		uint64_t total;             /* nanoseconds from begin to end of frame */
+		unsigned int ticks;         /* simulation ticks run during the frame */
+	};
+
+	/**
+	 * Number of frames kept.
+	 */
+	static const size_t history = 256;
+
+	class Scope {
+	public:
+		Scope(Profiler& profiler, Phase phase)
+			: profiler(profiler)
+			, phase(phase)
+			, start(Profiler::now()) {}
+
+		~Scope(){
+			profiler.add(phase, Profiler::now() - start);
+		}
+
+	private:
+		Profiler& profiler;
+		const Phase phase;
+		const uint64_t start;
+	};
+
+	Profiler();
+	~Profiler();
+
+	/**
+	 * Monotonic time in nanoseconds.
+	 */
+	static uint64_t now();
+
+	static const char* name(Phase phase);
+
+	void begin_frame();
+	void end_frame();
+
+	/**
+	 * Add time to a phase of the current frame.
+	 */
+	void add(Phase phase, uint64_t ns){
+		std::lock_guard<std::mutex> guard(lock);
+		current.phase[phase] += ns;
+	}
+
+	/**
+	 * Count a simulation tick in the current frame.
+	 */
+	void add_tick(){
+		std::lock_guard<std::mutex> guard(lock);
+		current.ticks++;
+	}
+
+	/**
+	 * Number of frames in the ring buffer.
+	 */
+	size_t size() const { return count; }
+
+	/**
+	 * Get a completed frame, 0 is the most recent.
+	 */
+	const Frame& frame(size_t age) const;
+
+	/**
+	 * Average and maximum over all frames in the ring buffer.
+	 */
+	void summary(Frame* avg, Frame* max) const;
+
+	/**
+	 * Write all frames in the ring buffer as CSV (oldest first).
+	 * @return false if the file could not be written.
+	 */
+	bool dump(const std::string& filename) const;
+
+	/**
+	 * Append every completed frame to a CSV file, exits if the file cannot be
+	 * created.
+	 */
+	void stream(const std::string& filename);
+
+private:
+	static void write_header(FILE* fp);
+	static void write_frame(FILE* fp, const Frame& frame);
+
+	Frame frames[history];
+	Frame current;
+	uint64_t frame_start;
+	size_t head;  /* next slot to write */
+	size_t count;
+	FILE* output;
+	mutable std::mutex lock;
+};
+
+#endif /* FROBNICATOR_PROFILER_H */
@@ -4,34 +4,26 @@
 
 #include "projectile.hpp"
 #include "common.hpp"
-#include "entity.hpp"
+#include "creep.hpp"
 #include "game.hpp"
 #include "sprite.hpp"
 
-Projectile::Projectile(const Vector2f& src, const Entity* dst, float speed, float len, const std::function<void()>& ready)
-	: src(src)
-	, dst(dst)
-	, ready(ready )
+Projectile::Projectile(const Vector2f& src, const Creep* dst, float speed, float len)
+	: damage(0.0f)
+	, src(src)
+	, dst(dst->handle())
+	, dst_pos(dst->world_pos())
+	, dst_offset(dst->sprite()->scale().x * 0.5f, dst->sprite()->scale().y * 0.5f)
 	, delay(Vector2f::distance(src, dst->world_pos()) / speed)
 	, cur(0.0f)
 	, len(len) {
 
-	Game::add_projectile(this);
-	dst->inc_ref();
-}
-
-Projectile::~Projectile(){
-	dst->dec_ref();
 }
 
 void Projectile::get_points(Vector2f* a, Vector2f* b) const {
 	const float s = cur / delay;
 
-	const Vector2f offset = Vector2f(
-		dst->sprite()->scale().x * 0.5f,
-		dst->sprite()->scale().y * 0.5f
-	);
-	const Vector2f real_dst = dst->world_pos() + offset;
+	const Vector2f real_dst = dst_pos + dst_offset;
 	const float distance = Vector2f::distance(src, real_dst);
 	const float l = len / distance;
 
@@ -40,11 +32,27 @@ void Projectile::get_points(Vector2f* a, Vector2f* b) const {
 }
 
 bool Projectile::tick(float dt){
+	/* follow target while it is alive */
+	const Creep* target = Game::find_creep(dst);
+	if ( target ){
+		dst_pos = target->world_pos();
+	}
+
 	if ( cur > delay ){
-		ready();
 		return true;
 	}
 
 	cur += dt;
 	return false;
 }
+
+void Projectile::resolve() const {
+	Creep* target = Game::find_creep(dst);
+	if ( !target ){
+		return;
+	}
+
+	target->damage(damage, source);
+	if ( slow.duration   > 0.0f ){ target->add_buff(slow); }
+	if ( poison.duration > 0.0f ){ target->add_buff(poison, source); }
+}
@@ -1,22 +1,24 @@
 #ifndef FROBNICATOR_PROJECTILE_H
 #define FROBNICATOR_PROJECTILE_H
 
+#include "buff.hpp"
+#include "pool.hpp"
 #include "vector.hpp"
-#include <functional>
 
+/**
+ * Projectile in flight. Plain data, the world stores them by value and the
+ * payload is applied to the target when it hits (see resolve).
+ */
 class Projectile {
 public:
 	/**
-	 * Create new projectile. Will be added to game automatically upon creation.
-	 * Do not deallocate memory, it will free itself when finished.
+	 * Create new projectile aimed at dst. It must be passed to
+	 * Game::add_projectile to be added to the world.
 	 *
 	 * @param speed Units per seconds.
 	 * @param len Projectile length.
-	 * @param ready Called once the projectile has hit the target.
 	 */
-	Projectile(const Vector2f& src, const Entity* dst, float speed, float len, const std::function<void()>& ready);
-
-	~Projectile();
+	Projectile(const Vector2f& src, const Creep* dst, float speed, float len);
 
 	/**
 	 * Get the current start- and end-point of the projectiles.
@@ -24,14 +26,28 @@ public:
 	void get_points(Vector2f* a, Vector2f* b) const;
 
 	/**
-	 * @return true if finished.
+	 * Move projectile and follow the target while it is alive.
+	 * @return true if it has hit.
 	 */
 	bool tick(float dt);
 
+	/**
+	 * Apply payload to the target. Nothing happens if the target has died
+	 * while the projectile was flying.
+	 */
+	void resolve() const;
+
+	/* payload */
+	Handle source;     /* building which fired it */
+	float damage;
+	SlowBuff slow;     /* only applied if duration > 0 */
+	PoisonBuff poison; /* only applied if duration > 0 */
+
 private:
 	Vector2f src;
-	const Entity* dst;
-	std::function<void()> ready;
+	Handle dst;
+	Vector2f dst_pos;     /* last known position of target */
+	Vector2f dst_offset;  /* offset to middle of target */
 	float delay;
 	float cur;
 	float len;
@@ -0,0 +1,44 @@
+#ifndef FROBNICATOR_RANDOM_H
+#define FROBNICATOR_RANDOM_H
+
+#include <stdint.h>
+
+/**
+ * Small seedable pseudo-random number generator (xorshift64*). Unlike rand()
+ * the sequence is the same on every platform so a match can be reproduced
+ * from its seed.
+ */
+class Random {
+public:
+	Random(uint64_t seed = 0){
+		reseed(seed);
+	}
+
+	void reseed(uint64_t seed){
+		/* splitmix64 to spread the seed, the state must never be zero */
+		uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		state = (z ^ (z >> 31)) | 1;
+	}
+
+	uint32_t next(){
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return (uint32_t)((state * 0x2545F4914F6CDD1DULL) >> 32);
+	}
+
+	/**
+	 * Random integer in range [0, n).
+	 */
+	int range(int n){
+		if ( n <= 0 ) return 0;
+		return (int)(((uint64_t)next() * (uint64_t)n) >> 32);
+	}
+
+private:
+	uint64_t state;
+};
+
+#endif /* FROBNICATOR_RANDOM_H */
@@ -10,11 +10,11 @@ Region::Region(){
 
 }
 
-Vector2f Region::random_point(const Vector2i& size) const {
+Vector2f Region::random_point(Random& rng, const Vector2i& size) const {
 	const int dx = _w - size.x;
 	const int dy = _h - size.y;
-	const int rx = dx > 0 ? rand() % dx : 0;
-	const int ry = dy > 0 ? rand() % dy : 0;
+	const int rx = rng.range(dx);
+	const int ry = rng.range(dy);
 	return Vector2f(_x + rx, _y + ry);
 }
 
@@ -37,17 +37,25 @@ bool Region::contains(const Vector2f& pos, const Vector2f& size, bool inside) co
 	return true;
 }
 
-void Region::set(const std::string& key, const std::string& value){
-	     if ( key == "name" ){ _name = value; }
-	else if ( key == "x" ){ _x = atoi(value.c_str()); }
-	else if ( key == "y" ){ _y = atoi(value.c_str()); }
-	else if ( key == "w" ){ _w = atoi(value.c_str()); }
-	else if ( key == "h" ){ _h = atoi(value.c_str()); }
-	else {
-		fprintf(stderr, "    - Region `%s' got unhandled key `%s', ignored\n", _name.c_str(), key.c_str());
+bool Region::set(Keyword::Id key, const ScalarView& value){
+	switch ( key ){
+	case Keyword::NAME: _name = value.str(); return true;
+	case Keyword::X: _x = value.to_int(); return true;
+	case Keyword::Y: _y = value.to_int(); return true;
+	case Keyword::W: _w = value.to_int(); return true;
+	case Keyword::H: _h = value.to_int(); return true;
+	default: return false;
 	}
 }
 
+void Region::assign(const std::string& name, int x, int y, int w, int h){
+	_name = name;
+	_x = x;
+	_y = y;
+	_w = w;
+	_h = h;
+}
+
 void Region::parse(yaml_parser_t* parser){
 	yaml_event_t ekey;
 	yaml_event_t eval;
@@ -69,9 +77,10 @@ void Region::parse(yaml_parser_t* parser){
 		yaml_parser_parse(parser, &eval) || yaml_error(parser);
 
 		/* delegate parsing of value */
-		const std::string key = std::string((const char*)ekey.data.scalar.value, ekey.data.scalar.length);
-		const std::string val = std::string((const char*)eval.data.scalar.value, eval.data.scalar.length);
-		this->set(key, val);
+		const ScalarView key(ekey);
+		if ( !this->set(Keyword::lookup(key), ScalarView(eval)) ){
+			fprintf(stderr, "    - Region `%s' got unhandled key `%.*s', ignored\n", _name.c_str(), (int)key.size(), key.data());
+		}
 
 	} while ( true );
 }
@@ -1,6 +1,8 @@
 #ifndef DVB021_REGION_H
 #define DVB021_REGION_H
 
+#include "keyword.hpp"
+#include "random.hpp"
 #include "vector.hpp"
 #include <string>
 
@@ -18,9 +20,10 @@ public:
 	/**
 	 * Generete a random point within the region.
 	 *
+	 * @param rng Generator to use.
 	 * @param size If given fits a AABB within the region.
 	 */
-	Vector2f random_point(const Vector2i& size = Vector2i(0,0)) const;
+	Vector2f random_point(Random& rng, const Vector2i& size = Vector2i(0,0)) const;
 
 	/**
 	 * Get the middle coordinates of this region.
@@ -35,9 +38,18 @@ public:
 	bool contains(const Vector2f& pos, const Vector2f& size, bool inside=false) const;
 
 protected:
-	virtual void set(const std::string& key, const std::string& value);
+	/**
+	 * Set property from YAML.
+	 * @return false if the key is not handled.
+	 */
+	virtual bool set(Keyword::Id key, const ScalarView& value);
 	void parse(yaml_parser_t* parser);
 
+	/**
+	 * Set name and bounds directly (used by compiled tilemaps).
+	 */
+	void assign(const std::string& name, int x, int y, int w, int h);
+
 private:
 	std::string _name;
 	int _x;
@@ -0,0 +1,108 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render_list.hpp"
+#include <algorithm>
+#include <limits>
+
+RenderList::RenderList()
+	: tick(std::numeric_limits<uint64_t>::max())
+	, num_creep(0) {
+
+}
+
+void RenderList::update(const Snapshot& snap, float alpha){
+	const size_t n = snap.entities.size();
+	depth.resize(n);
+	for ( size_t i = 0; i < n; i++ ){
+		const Snapshot::Entity& ent = snap.entities[i];
+		depth[i] = ent.prev.y + (ent.pos.y - ent.prev.y) * alpha;
+	}
+
+	if ( snap.tick != tick ){
+		carry_over(snap);
+	} else {
+		insertion_sort();
+	}
+
+	sorted.resize(n);
+	for ( size_t i = 0; i < n; i++ ){
+		const Snapshot::Entity& ent = snap.entities[order[i]];
+		sorted[i] = ent;
+		sorted[i].pos = ent.prev + (ent.pos - ent.prev) * alpha;
+	}
+}
+
+/**
+ * Make order refer to a new snapshot. Pools keep objects in insertion order
+ * so both snapshots list the remaining entities in the same order and new
+ * entities come after them, which allows matching them in a single pass.
+ */
+void RenderList::carry_over(const Snapshot& snap){
+	const size_t n = snap.entities.size();
+	remap.assign(handles.size(), -1);
+	added.clear();
+
+	/* creep and buildings are matched separately as handles are per pool */
+	const size_t old_range[2][2] = {{0, num_creep}, {num_creep, handles.size()}};
+	const size_t new_range[2][2] = {{0, snap.num_creep}, {snap.num_creep, n}};
+	for ( int s = 0; s < 2; s++ ){
+		size_t p = old_range[s][0];
+		size_t j = new_range[s][0];
+		for ( ; j < new_range[s][1]; j++ ){
+			const Handle& handle = snap.entities[j].handle;
+			size_t q = p;
+			while ( q < old_range[s][1] && handles[q] != handle ) q++;
+			if ( q == old_range[s][1] ) break; /* this and the rest are new */
+			remap[q] = j;
+			p = q + 1;
+		}
+		for ( ; j < new_range[s][1]; j++ ){
+			added.push_back(j);
+		}
+	}
+
+	/* remaining entities keep their relative order, which is nearly sorted */
+	size_t kept = 0;
+	for ( size_t i = 0; i < order.size(); i++ ){
+		const int32_t index = remap[order[i]];
+		if ( index >= 0 ){
+			order[kept++] = index;
+		}
+	}
+	order.resize(kept);
+	insertion_sort();
+
+	/* new entities (e.g. a spawned wave) have no previous order */
+	if ( !added.empty() ){
+		std::sort(added.begin(), added.end(), [this](uint32_t a, uint32_t b){
+			return depth[a] < depth[b];
+		});
+		merged.resize(order.size() + added.size());
+		std::merge(order.begin(), order.end(), added.begin(), added.end(), merged.begin(), [this](uint32_t a, uint32_t b){
+			return depth[a] < depth[b];
+		});
+		order.swap(merged);
+	}
+
+	tick = snap.tick;
+	num_creep = snap.num_creep;
+	handles.resize(n);
+	for ( size_t i = 0; i < n; i++ ){
+		handles[i] = snap.entities[i].handle;
+	}
+}
+
+void RenderList::insertion_sort(){
+	for ( size_t i = 1; i < order.size(); i++ ){
+		const uint32_t index = order[i];
+		const float d = depth[index];
+		size_t j = i;
+		while ( j > 0 && depth[order[j - 1]] > d ){
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = index;
+	}
+}
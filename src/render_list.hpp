@@ -0,0 +1,52 @@
+#ifndef FROBNICATOR_RENDER_LIST_H
+#define FROBNICATOR_RENDER_LIST_H
+
+#include "pool.hpp"
+#include "snapshot.hpp"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Entities of a snapshot interpolated and ordered by depth (y), kept between
+ * frames.
+ *
+ * Entities move only slightly from one frame to the next so the order of the
+ * previous frame is nearly right and an insertion sort fixes it in close to
+ * linear time. When a new snapshot arrives the order is carried over to it by
+ * matching handles, entities which are new are sorted on their own and merged
+ * in. All buffers are reused so steady-state frames do not allocate.
+ */
+class RenderList {
+public:
+	RenderList();
+
+	/**
+	 * Update positions and order.
+	 * @param alpha How far between the previous and the latest tick the frame is.
+	 */
+	void update(const Snapshot& snap, float alpha);
+
+	/**
+	 * Interpolated entities in depth order.
+	 */
+	const std::vector<Snapshot::Entity>& entities() const { return sorted; }
+
+private:
+	void carry_over(const Snapshot& snap);
+	void insertion_sort();
+
+	uint64_t tick;                    /* snapshot order refers to */
+	size_t num_creep;                 /* in that snapshot */
+	std::vector<Handle> handles;      /* of that snapshot, in snapshot order */
+	std::vector<uint32_t> order;      /* snapshot indices in depth order */
+	std::vector<float> depth;         /* interpolated y by snapshot index */
+	std::vector<Snapshot::Entity> sorted;
+
+	/* scratch when carrying over */
+	std::vector<int32_t> remap;       /* previous index to new index or -1 */
+	std::vector<uint32_t> added;
+	std::vector<uint32_t> merged;
+};
+
+#endif /* FROBNICATOR_RENDER_LIST_H */
@@ -0,0 +1,166 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "replay.hpp"
+#include <cstdlib>
+#include <cstring>
+
+static const int format_version = 1;
+
+Recorder::Recorder(const std::string& filename, const std::string& level, uint64_t seed){
+	fp = fopen(filename.c_str(), "w");
+	if ( !fp ){
+		fprintf(stderr, "Failed to open `%s' for recording.\n", filename.c_str());
+		exit(1);
+	}
+
+	fprintf(fp, "frobnicator-replay %d\n", format_version);
+	fprintf(fp, "level %s\n", level.c_str());
+	fprintf(fp, "seed %llu\n", (unsigned long long)seed);
+}
+
+Recorder::~Recorder(){
+	fclose(fp);
+}
+
+void Recorder::command(const Command& cmd){
+	const unsigned long long tick = cmd.tick;
+	switch ( cmd.type ){
+	case Command::BUILD:   fprintf(fp, "%llu build %d %d %d\n", tick, cmd.pos.x, cmd.pos.y, cmd.arg); break;
+	case Command::UPGRADE: fprintf(fp, "%llu upgrade %d %d\n", tick, cmd.pos.x, cmd.pos.y); break;
+	case Command::SELL:    fprintf(fp, "%llu sell %d %d\n", tick, cmd.pos.x, cmd.pos.y); break;
+	case Command::BUTTON:  fprintf(fp, "%llu button %d %d %d\n", tick, cmd.pos.x, cmd.pos.y, cmd.arg); break;
+	case Command::KEY:     fprintf(fp, "%llu key %s\n", tick, cmd.key.c_str()); break;
+	}
+}
+
+void Recorder::hash(uint64_t tick, uint64_t hash){
+	fprintf(fp, "%llu hash %016llx\n", (unsigned long long)tick, (unsigned long long)hash);
+}
+
+void Recorder::end(uint64_t tick){
+	fprintf(fp, "%llu end\n", (unsigned long long)tick);
+	fflush(fp);
+}
+
+Replay::Replay()
+	: _seed(0)
+	, _end(0)
+	, cur_command(0)
+	, cur_hash(0)
+	, _verified(0)
+	, mismatch(false) {
+
+}
+
+Replay* Replay::from_filename(const std::string& filename){
+	FILE* fp = fopen(filename.c_str(), "r");
+	if ( !fp ){
+		fprintf(stderr, "Failed to open replay `%s'.\n", filename.c_str());
+		exit(1);
+	}
+
+	Replay* replay = new Replay;
+	char line[1024];
+	char word[64];
+	unsigned int lineno = 0;
+
+	while ( fgets(line, sizeof(line), fp) ){
+		lineno++;
+
+		/* header */
+		int version;
+		unsigned long long seed;
+		if ( lineno == 1 ){
+			if ( sscanf(line, "frobnicator-replay %d", &version) != 1 || version != format_version ){
+				fprintf(stderr, "`%s' is not a replay (or an unsupported version).\n", filename.c_str());
+				exit(1);
+			}
+			continue;
+		}
+		if ( strncmp(line, "level ", 6) == 0 ){
+			replay->_level = std::string(line + 6, strcspn(line + 6, "\r\n"));
+			continue;
+		}
+		if ( sscanf(line, "seed %llu", &seed) == 1 ){
+			replay->_seed = seed;
+			continue;
+		}
+
+		/* events */
+		unsigned long long tick;
+		int n;
+		if ( sscanf(line, "%llu %63s %n", &tick, word, &n) < 2 ){
+			fprintf(stderr, "%s:%d: malformed line, ignored.\n", filename.c_str(), lineno);
+			continue;
+		}
+
+		const char* args = line + n;
+		Command cmd;
+		cmd.tick = tick;
+		unsigned long long hash;
+
+		if ( strcmp(word, "build") == 0 && sscanf(args, "%d %d %d", &cmd.pos.x, &cmd.pos.y, &cmd.arg) == 3 ){
+			cmd.type = Command::BUILD;
+			replay->commands.push_back(cmd);
+		} else if ( strcmp(word, "upgrade") == 0 && sscanf(args, "%d %d", &cmd.pos.x, &cmd.pos.y) == 2 ){
+			cmd.type = Command::UPGRADE;
+			replay->commands.push_back(cmd);
+		} else if ( strcmp(word, "sell") == 0 && sscanf(args, "%d %d", &cmd.pos.x, &cmd.pos.y) == 2 ){
+			cmd.type = Command::SELL;
+			replay->commands.push_back(cmd);
+		} else if ( strcmp(word, "hash") == 0 && sscanf(args, "%llx", &hash) == 1 ){
+			replay->hashes.push_back(std::make_pair((uint64_t)tick, (uint64_t)hash));
+		} else if ( strcmp(word, "end") == 0 ){
+			replay->_end = tick;
+		} else if ( strcmp(word, "button") == 0 || strcmp(word, "key") == 0 ){
+			/* input events are only informative */
+		} else {
+			fprintf(stderr, "%s:%d: unknown event `%s', ignored.\n", filename.c_str(), lineno, word);
+		}
+	}
+
+	fclose(fp);
+
+	if ( replay->_level.empty() ){
+		fprintf(stderr, "Replay `%s' is missing level.\n", filename.c_str());
+		exit(1);
+	}
+
+	return replay;
+}
+
+bool Replay::next(uint64_t tick, Command* cmd){
+	if ( cur_command == commands.size() || commands[cur_command].tick > tick ){
+		return false;
+	}
+
+	*cmd = commands[cur_command++];
+	return true;
+}
+
+bool Replay::verify(uint64_t tick, uint64_t hash){
+	/* skip hashes for ticks never reached */
+	while ( cur_hash < hashes.size() && hashes[cur_hash].first < tick ){
+		cur_hash++;
+	}
+
+	if ( cur_hash == hashes.size() || hashes[cur_hash].first != tick ){
+		return true;
+	}
+
+	const uint64_t expected = hashes[cur_hash++].second;
+	if ( expected == hash ){
+		_verified++;
+		return true;
+	}
+
+	if ( !mismatch ){
+		fprintf(stderr, "Replay diverged at tick %llu: state hash %016llx, expected %016llx\n",
+		        (unsigned long long)tick, (unsigned long long)hash, (unsigned long long)expected);
+		mismatch = true;
+	}
+
+	return false;
+}
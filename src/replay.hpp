@@ -0,0 +1,129 @@
+#ifndef FROBNICATOR_REPLAY_H
+#define FROBNICATOR_REPLAY_H
+
+#include "vector.hpp"
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Something the player did during a match. Only gameplay commands (build,
+ * upgrade and sell) are applied when replaying, the raw input events are
+ * recorded for reference as they depend on camera and window size.
+ */
+struct Command {
+	enum Type {
+		BUILD,    /* pos = grid position, arg = building type */
+		UPGRADE,  /* pos = grid position of building */
+		SELL,     /* pos = grid position of building */
+		BUTTON,   /* pos = screen position, arg = mouse button */
+		KEY,      /* key = name of binding */
+	};
+
+	Command()
+		: tick(0)
+		, type(BUILD)
+		, arg(0) {}
+
+	Command(uint64_t tick, Type type, const Vector2i& pos, int arg = 0)
+		: tick(tick)
+		, type(type)
+		, pos(pos)
+		, arg(arg) {}
+
+	Command(uint64_t tick, const std::string& key)
+		: tick(tick)
+		, type(KEY)
+		, arg(0)
+		, key(key) {}
+
+	uint64_t tick;
+	Type type;
+	Vector2i pos;
+	int arg;
+	std::string key;
+};
+
+/**
+ * Writes a match to a file. The file is a plain text log:
+ *
+ *   frobnicator-replay 1
+ *   level maul.level
+ *   seed 1234
+ *   <tick> build <x> <y> <type>
+ *   <tick> hash <hex>
+ *   ...
+ *   <tick> end
+ */
+class Recorder {
+public:
+	/**
+	 * Open file for writing, exits if the file cannot be created.
+	 */
+	Recorder(const std::string& filename, const std::string& level, uint64_t seed);
+	~Recorder();
+
+	void command(const Command& cmd);
+	void hash(uint64_t tick, uint64_t hash);
+
+	/**
+	 * Mark the end of the match.
+	 */
+	void end(uint64_t tick);
+
+private:
+	FILE* fp;
+};
+
+/**
+ * A match read back from file.
+ */
+class Replay {
+public:
+	/**
+	 * Load recorded match, exits if the file cannot be parsed.
+	 */
+	static Replay* from_filename(const std::string& filename);
+
+	const std::string& level() const { return _level; }
+	uint64_t seed() const { return _seed; }
+
+	/**
+	 * Tick the match ended at, or 0 if the recording was never finished.
+	 */
+	uint64_t end() const { return _end; }
+
+	/**
+	 * Get the next gameplay command which should be applied at tick (call
+	 * repeatedly until it returns false).
+	 */
+	bool next(uint64_t tick, Command* cmd);
+
+	/**
+	 * Compare state hash with the recording (if one was recorded at tick).
+	 * Prints a message on the first mismatch.
+	 * @return false if the hash differs.
+	 */
+	bool verify(uint64_t tick, uint64_t hash);
+
+	/**
+	 * Number of hashes verified so far.
+	 */
+	unsigned int verified() const { return _verified; }
+
+private:
+	Replay();
+
+	std::string _level;
+	uint64_t _seed;
+	uint64_t _end;
+	std::vector<Command> commands;
+	std::vector<std::pair<uint64_t, uint64_t> > hashes; /* tick, hash */
+	size_t cur_command;
+	size_t cur_hash;
+	unsigned int _verified;
+	bool mismatch;
+};
+
+#endif /* FROBNICATOR_REPLAY_H */
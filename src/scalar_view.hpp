@@ -0,0 +1,57 @@
+#ifndef FROBNICATOR_SCALAR_VIEW_H
+#define FROBNICATOR_SCALAR_VIEW_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <yaml.h>
+
+/**
+ * Non-owning view of a YAML scalar, used by the loaders to look at keys and
+ * values without copying them into strings.
+ *
+ * It points into the event so it is only valid as long as the event is.
+ * libyaml always NUL-terminates scalars so the numeric conversions can read
+ * the data directly.
+ */
+class ScalarView {
+public:
+	ScalarView()
+		: _data("")
+		, _size(0) {}
+
+	ScalarView(const char* data, size_t size)
+		: _data(data)
+		, _size(size) {}
+
+	explicit ScalarView(const yaml_event_t& event)
+		: _data(reinterpret_cast<const char*>(event.data.scalar.value))
+		, _size(event.data.scalar.length) {}
+
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+
+	bool operator==(const char* str) const {
+		/* lengths first, the scalar may contain NUL */
+		return strlen(str) == _size && memcmp(str, _data, _size) == 0;
+	}
+
+	bool operator!=(const char* str) const {
+		return !(*this == str);
+	}
+
+	bool starts_with(const char* prefix) const {
+		const size_t n = strlen(prefix);
+		return n <= _size && memcmp(_data, prefix, n) == 0;
+	}
+
+	std::string str() const { return std::string(_data, _size); }
+	int to_int() const { return atoi(_data); }
+	float to_float() const { return (float)atof(_data); }
+
+private:
+	const char* _data;
+	size_t _size;
+};
+
+#endif /* FROBNICATOR_SCALAR_VIEW_H */
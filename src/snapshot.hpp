@@ -0,0 +1,94 @@
+#ifndef FROBNICATOR_SNAPSHOT_H
+#define FROBNICATOR_SNAPSHOT_H
+
+#include "color.hpp"
+#include "forward.hpp"
+#include "pool.hpp"
+#include "vector.hpp"
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Copy of everything the renderer needs from one simulation tick, published
+ * by the simulation thread so rendering never touches the live world.
+ *
+ * Moving things have both the position at the previous tick and at this
+ * tick so the renderer can interpolate between them.
+ */
+struct Snapshot {
+	struct Entity {
+		Handle handle; /* creep and buildings are from different pools */
+		const Sprite* sprite;
+		Vector2f prev;
+		Vector2f pos;
+		float hp; /* current / max */
+	};
+
+	/**
+	 * Building stats for selection and the infobox.
+	 */
+	struct Building {
+		Handle handle;
+		Vector2i grid;
+		const Blueprint* blueprint;
+		int level;
+		float damage;
+		float range;
+		float rof;
+		float slow;
+		float slow_duration;
+		int upgrade_cost;
+		int sell_cost;
+		bool have_slow;
+		bool can_upgrade;
+	};
+
+	struct Projectile {
+		Vector2f prev[2]; /* start- and end-point */
+		Vector2f pos[2];
+	};
+
+	struct Message {
+		Vector2f pos;
+		Color color;
+		std::string text;
+	};
+
+	Snapshot()
+		: tick(0)
+		, time(0)
+		, gold(0)
+		, lives(0)
+		, wave_left(0)
+		, num_creep(0) {}
+
+	const Building* find_building(const Handle& handle) const {
+		for ( auto it = buildings.begin(); it != buildings.end(); ++it ){
+			if ( handle.valid() && it->handle == handle ) return &*it;
+		}
+		return NULL;
+	}
+
+	const Building* building_at(const Vector2i& grid) const {
+		for ( auto it = buildings.begin(); it != buildings.end(); ++it ){
+			if ( it->grid == grid ) return &*it;
+		}
+		return NULL;
+	}
+
+	uint64_t tick;
+	uint64_t time;    /* wallclock (microseconds) when published */
+	int gold;
+	int lives;
+	int wave_left;
+	size_t num_creep;
+
+	std::vector<Entity> entities;     /* all creep followed by all buildings */
+	std::vector<Building> buildings;
+	std::vector<Projectile> projectiles;
+	std::vector<Message> messages;
+};
+
+#endif /* FROBNICATOR_SNAPSHOT_H */
@@ -0,0 +1,203 @@
+#ifndef FROBNICATOR_SPATIAL_H
+#define FROBNICATOR_SPATIAL_H
+
+#include "vector.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <math.h>
+
+/**
+ * Uniform grid bucketing objects by position, used to find the nearest object
+ * within range without testing every object.
+ *
+ * The grid is rebuilt from scratch by calling insert() for every object
+ * followed by build(). Objects are stored by cell in a single contiguous
+ * array (counting sort) so a query only touches the cells overlapping the
+ * search radius. Positions outside the grid are clamped to the border cells.
+ */
+template <class T>
+class SpatialGrid {
+public:
+	SpatialGrid()
+		: cell_width(1.0f)
+		, cell_height(1.0f)
+		, cols(1)
+		, rows(1) {}
+
+	/**
+	 * Resize the grid, removes all objects.
+	 * @param width Number of cells horizontally.
+	 * @param height Number of cells vertically.
+	 * @param cell_size Size of a cell in world units.
+	 */
+	void resize(size_t width, size_t height, const Vector2f& cell_size){
+		cols = width  > 0 ? width  : 1;
+		rows = height > 0 ? height : 1;
+		cell_width  = cell_size.x;
+		cell_height = cell_size.y;
+		clear();
+	}
+
+	/**
+	 * Remove all objects.
+	 */
+	void clear(){
+		staging.clear();
+		entries.clear();
+		offset.assign(cols * rows + 1, 0);
+	}
+
+	/**
+	 * Add object, it is not visible to queries until build() is called.
+	 * Objects must be inserted in a deterministic order as it is used to break
+	 * ties between objects at the same distance.
+	 */
+	void insert(T* obj, const Vector2f& pos){
+		Entry e;
+		e.pos = pos;
+		e.obj = obj;
+		e.order = staging.size();
+		e.cell = cell_index(pos);
+		staging.push_back(e);
+	}
+
+	/**
+	 * Sort all inserted objects into cells.
+	 */
+	void build(){
+		offset.assign(cols * rows + 1, 0);
+		for ( auto it = staging.begin(); it != staging.end(); ++it ){
+			offset[it->cell + 1]++;
+		}
+		for ( size_t i = 1; i < offset.size(); i++ ){
+			offset[i] += offset[i-1];
+		}
+
+		/* stable, so each cell retains insertion order */
+		entries.resize(staging.size());
+		std::vector<size_t> cursor(offset.begin(), offset.end() - 1);
+		for ( auto it = staging.begin(); it != staging.end(); ++it ){
+			entries[cursor[it->cell]++] = *it;
+		}
+		staging.clear();
+	}
+
+	/**
+	 * Find the object nearest to pos with a distance less than range. If
+	 * several objects are at the same distance the first inserted wins, i.e.
+	 * the result is the same as a linear scan would give.
+	 * @return Object or NULL if nothing is within range.
+	 */
+	T* nearest(const Vector2f& pos, float range) const {
+		const int x0 = cell_x(pos.x - range);
+		const int x1 = cell_x(pos.x + range);
+		const int y0 = cell_y(pos.y - range);
+		const int y1 = cell_y(pos.y + range);
+		const int cx = cell_x(pos.x);
+		const int cy = cell_y(pos.y);
+
+		const Entry* best = NULL;
+		float current = range;
+
+		/* visit cells in rings around pos so the nearest candidates are found
+		 * early and the search can stop once the rings are out of reach */
+		const int rings = std::max(std::max(cx - x0, x1 - cx), std::max(cy - y0, y1 - cy));
+		const float ring_size = std::min(cell_width, cell_height);
+		for ( int r = 0; r <= rings; r++ ){
+			/* everything in ring r is at least r-1 cells away */
+			if ( best && (r - 1) * ring_size - 1.0f > current ) break;
+
+			for ( int y = std::max(cy - r, y0); y <= std::min(cy + r, y1); y++ ){
+				const bool edge = y == cy - r || y == cy + r;
+				const int step = edge ? 1 : 2 * r; /* only the left and right cell on inner rows */
+
+				for ( int x = cx - r; x <= cx + r; x += step ){
+					if ( x < x0 || x > x1 ) continue;
+
+					/* skip cells further away than the best candidate so far */
+					if ( best && cell_gap(x, y, pos) > current ) continue;
+
+					search_cell(x, y, pos, best, current);
+				}
+			}
+		}
+
+		return best ? best->obj : NULL;
+	}
+
+	/**
+	 * Number of objects available to queries.
+	 */
+	size_t size() const {
+		return entries.size();
+	}
+
+private:
+	struct Entry {
+		Vector2f pos;
+		T* obj;
+		size_t order;
+		size_t cell;
+	};
+
+	void search_cell(int x, int y, const Vector2f& pos, const Entry*& best, float& current) const {
+		const size_t cell = y * cols + x;
+		for ( size_t i = offset[cell]; i < offset[cell+1]; i++ ){
+			const Entry& e = entries[i];
+
+			/* the distance is never less than the distance along either axis */
+			if ( fabsf(e.pos.x - pos.x) > current || fabsf(e.pos.y - pos.y) > current ) continue;
+
+			/* same metric as the linear scan so results are exact */
+			const float distance = Vector2f::distance(pos, e.pos);
+			if ( distance < current || (best && distance == current && e.order < best->order) ){
+				best = &e;
+				current = distance;
+			}
+		}
+	}
+
+	/**
+	 * Lower bound of the distance along either axis from pos to anything in
+	 * the cell. Border cells extend to infinity as positions are clamped, and
+	 * a margin of one unit covers rounding when objects are bucketed.
+	 */
+	float cell_gap(int x, int y, const Vector2f& pos) const {
+		const float left   = x == 0             ? -HUGE_VALF : x * cell_width;
+		const float right  = x == (int)cols - 1 ?  HUGE_VALF : (x + 1) * cell_width;
+		const float top    = y == 0             ? -HUGE_VALF : y * cell_height;
+		const float bottom = y == (int)rows - 1 ?  HUGE_VALF : (y + 1) * cell_height;
+
+		float gap = 0.0f;
+		if ( pos.x < left   ) gap = left - pos.x;
+		if ( pos.x > right  ) gap = pos.x - right;
+		if ( pos.y < top    && top - pos.y > gap    ) gap = top - pos.y;
+		if ( pos.y > bottom && pos.y - bottom > gap ) gap = pos.y - bottom;
+		return gap - 1.0f;
+	}
+
+	int cell_x(float x) const {
+		const int cx = (int)floorf(x / cell_width);
+		return cx < 0 ? 0 : (cx >= (int)cols ? (int)cols - 1 : cx);
+	}
+
+	int cell_y(float y) const {
+		const int cy = (int)floorf(y / cell_height);
+		return cy < 0 ? 0 : (cy >= (int)rows ? (int)rows - 1 : cy);
+	}
+
+	size_t cell_index(const Vector2f& pos) const {
+		return cell_y(pos.y) * cols + cell_x(pos.x);
+	}
+
+	float cell_width;
+	float cell_height;
+	size_t cols;
+	size_t rows;
+	std::vector<Entry> staging;   /* inserted but not yet built */
+	std::vector<Entry> entries;   /* sorted by cell */
+	std::vector<size_t> offset;   /* first entry of each cell, cols*rows+1 elements */
+};
+
+#endif /* FROBNICATOR_SPATIAL_H */
@@ -11,9 +11,19 @@ public:
 		return ptr;
 	}
 
-	virtual void set(const std::string& key, const std::string& value){
-		if ( key == "next" ){  next = value; }
-		else { Region::set(key, value); }
+	static Spawnpoint* create(const std::string& name, int x, int y, int w, int h, const std::string& next){
+		auto ptr = new Spawnpoint;
+		ptr->assign(name, x, y, w, h);
+		ptr->next = next;
+		return ptr;
+	}
+
+	virtual bool set(Keyword::Id key, const ScalarView& value){
+		if ( key == Keyword::NEXT ){
+			next = value.str();
+			return true;
+		}
+		return Region::set(key, value);
 	}
 
 	std::string next; /* hack... */
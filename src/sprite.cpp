@@ -5,15 +5,19 @@
 #include "sprite.hpp"
 #include "common.hpp"
 #include "game.hpp"
+#include "keyword.hpp"
 #include <yaml.h>
 
 Sprite::Sprite(const Sprite* base)
 	: _offset(0,0)
-	, _scale(1,1) {
+	, _scale(1,1)
+	, _tile_scale(0,0) {
 
 	if ( base ){
 		_offset = base->_offset;
 		_scale = base->_scale;
+		_texture = base->_texture;
+		_tile_scale = base->_tile_scale;
 	}
 }
 
@@ -48,19 +52,27 @@ Sprite* Sprite::from_yaml(yaml_parser_t* parser, const Sprite* base){
 			abort();
 		}
 
-		const std::string key((const char*)event.data.scalar.value, event.data.scalar.length);
+		const ScalarView key(event);
 
-		if ( key == "texture" ){
+		switch ( Keyword::lookup(key) ){
+		case Keyword::TEXTURE: {
 			yaml_parser_parse(parser, &evalue) || yaml_error(parser);
-			const std::string texture((const char*)evalue.data.scalar.value, evalue.data.scalar.length);
+			const std::string texture = ScalarView(evalue).str();
 			sprite->load_texture(texture);
-		} else if ( key == "offset" ){
+			sprite->_texture = texture;
+			sprite->_tile_scale = Vector2f(0,0);
+			break;
+		}
+		case Keyword::OFFSET:
 			sprite->set_offset(Vector2f::from_yaml(parser));
-		} else if ( key == "scale" ){
-			sprite->set_scale(Vector2f::from_yaml(parser) * Vector2f(Game::tile_width(), Game::tile_height()));
-		} else {
+			break;
+		case Keyword::SCALE:
+			sprite->_tile_scale = Vector2f::from_yaml(parser);
+			sprite->set_scale(sprite->_tile_scale * Vector2f(Game::tile_width(), Game::tile_height()));
+			break;
+		default:
 			/* warning only */
-			fprintf(stderr, "Unhandled key `%s'\n", key.c_str());
+			fprintf(stderr, "Unhandled key `%.*s'\n", (int)key.size(), key.data());
 		}
 
 	} while (1);
@@ -69,5 +81,20 @@ Sprite* Sprite::from_yaml(yaml_parser_t* parser, const Sprite* base){
 Sprite* Sprite::from_filename(const std::string& filename){
 	Sprite* sprite = Game::create_sprite();
 	sprite->load_texture(filename);
+	sprite->_texture = filename;
+	return sprite;
+}
+
+Sprite* Sprite::from_source(const std::string& texture, const Vector2f& offset, const Vector2f& tile_scale){
+	Sprite* sprite = Game::create_sprite();
+	if ( !texture.empty() ){
+		sprite->load_texture(texture);
+		sprite->_texture = texture;
+	}
+	sprite->set_offset(offset);
+	if ( tile_scale.x != 0.0f || tile_scale.y != 0.0f ){
+		sprite->_tile_scale = tile_scale;
+		sprite->set_scale(tile_scale * Vector2f(Game::tile_width(), Game::tile_height()));
+	}
 	return sprite;
 }
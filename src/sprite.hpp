@@ -12,10 +12,18 @@ public:
 	static Sprite* from_yaml(yaml_parser_t* parser, const Sprite* base);
 	static Sprite* from_filename(const std::string& filename);
 
+	/**
+	 * Recreate a sprite from what from_yaml recorded.
+	 * @param tile_scale Scale in tiles or zero to use the texture size.
+	 */
+	static Sprite* from_source(const std::string& texture, const Vector2f& offset, const Vector2f& tile_scale);
+
 	virtual Sprite* load_texture(const std::string& filename) = 0;
 
 	const Vector2f& FROB_PURE offset() const { return _offset; }
 	const Vector2f& FROB_PURE scale() const { return _scale; }
+	const std::string& texture_name() const { return _texture; }
+	const Vector2f& tile_scale() const { return _tile_scale; }
 	Sprite* set_offset(const Vector2f& offset){ _offset = offset; return this; }
 	Sprite* set_scale(const Vector2f& scale){ _scale = scale; return this; }
 
@@ -27,6 +35,10 @@ public:
 private:
 	Vector2f _offset;
 	Vector2f _scale;
+
+	/* as given by data files, see from_source */
+	std::string _texture;
+	Vector2f _tile_scale;
 };
 
 #endif /* FROBNICATOR_SPRITE_H */
@@ -0,0 +1,113 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sprite_batch.hpp"
+#include <algorithm>
+
+/* how many groups to look back when searching for a matching texture */
+static const size_t max_lookback = 32;
+
+static uint8_t to_byte(float v){
+	if ( v <= 0.0f ) return 0;
+	if ( v >= 1.0f ) return 0xFF;
+	return static_cast<uint8_t>(v * 255.0f + 0.5f);
+}
+
+static bool overlaps(const Vector2f& amin, const Vector2f& amax, const Vector2f& bmin, const Vector2f& bmax){
+	return amin.x < bmax.x && amax.x > bmin.x && amin.y < bmax.y && amax.y > bmin.y;
+}
+
+SpriteBatch::SpriteBatch()
+	: num_groups(0)
+	, num_quads(0) {
+
+}
+
+void SpriteBatch::clear(){
+	for ( size_t i = 0; i < num_groups; i++ ){
+		groups[i].vertices.clear();
+	}
+	num_groups = 0;
+	num_quads = 0;
+	_vertices.clear();
+	_runs.clear();
+}
+
+SpriteBatch::Group* SpriteBatch::find_group(unsigned int texture, const Vector2f& min, const Vector2f& max){
+	const size_t stop = num_groups > max_lookback ? num_groups - max_lookback : 0;
+
+	for ( size_t i = num_groups; i > stop; i-- ){
+		Group& group = groups[i-1];
+		if ( group.texture == texture ){
+			return &group;
+		}
+
+		/* the quad cannot be moved behind something it overlaps, the bounds
+		 * are tested first as most groups are far away */
+		if ( overlaps(min, max, group.min, group.max) ){
+			const std::vector<Vertex>& v = group.vertices;
+			for ( size_t j = 0; j < v.size(); j += 4 ){
+				if ( overlaps(min, max, Vector2f(v[j].x, v[j].y), Vector2f(v[j+2].x, v[j+2].y)) ){
+					return NULL;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+void SpriteBatch::add(unsigned int texture, const Vector2f& pos, const Vector2f& size, const Color& color,
+                      const Vector2f& uv0, const Vector2f& uv1){
+	const Vector2f min = pos;
+	const Vector2f max = pos + size;
+
+	Group* group = find_group(texture, min, max);
+	if ( group ){
+		group->min.x = std::min(group->min.x, min.x);
+		group->min.y = std::min(group->min.y, min.y);
+		group->max.x = std::max(group->max.x, max.x);
+		group->max.y = std::max(group->max.y, max.y);
+	} else {
+		if ( num_groups == groups.size() ){
+			groups.push_back(Group());
+		}
+		group = &groups[num_groups++];
+		group->texture = texture;
+		group->min = min;
+		group->max = max;
+	}
+
+	static const float corner[4][2] = {{0,0}, {1,0}, {1,1}, {0,1}};
+	Vertex v;
+	v.color[0] = to_byte(color.r);
+	v.color[1] = to_byte(color.g);
+	v.color[2] = to_byte(color.b);
+	v.color[3] = to_byte(color.a);
+	for ( int i = 0; i < 4; i++ ){
+		v.x = pos.x + size.x * corner[i][0];
+		v.y = pos.y + size.y * corner[i][1];
+		v.s = uv0.x + (uv1.x - uv0.x) * corner[i][0];
+		v.t = uv0.y + (uv1.y - uv0.y) * corner[i][1];
+		group->vertices.push_back(v);
+	}
+
+	num_quads++;
+}
+
+void SpriteBatch::build(){
+	_vertices.clear();
+	_runs.clear();
+	_vertices.reserve(num_quads * 4);
+
+	for ( size_t i = 0; i < num_groups; i++ ){
+		const Group& group = groups[i];
+		Run run;
+		run.texture = group.texture;
+		run.first = _vertices.size();
+		run.count = group.vertices.size();
+		_vertices.insert(_vertices.end(), group.vertices.begin(), group.vertices.end());
+		_runs.push_back(run);
+	}
+}
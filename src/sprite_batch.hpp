@@ -0,0 +1,93 @@
+#ifndef FROBNICATOR_SPRITE_BATCH_H
+#define FROBNICATOR_SPRITE_BATCH_H
+
+#include "color.hpp"
+#include "vector.hpp"
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Collects the quads of a frame and groups them by texture so they can be
+ * drawn with a few large draw calls instead of one per quad.
+ *
+ * Quads must be added in back-to-front order. A quad is only moved into an
+ * earlier group with the same texture if it does not overlap anything drawn
+ * in between, so the result looks exactly the same as drawing the quads one
+ * by one. The batch does not know about any graphics API, textures are just
+ * ids (0 means untextured).
+ */
+class SpriteBatch {
+public:
+	struct Vertex {
+		float x, y;
+		float s, t;
+		uint8_t color[4];
+	};
+
+	/**
+	 * A range of vertices (four per quad) sharing texture.
+	 */
+	struct Run {
+		unsigned int texture;
+		size_t first;
+		size_t count;
+	};
+
+	SpriteBatch();
+
+	/**
+	 * Remove all quads.
+	 */
+	void clear();
+
+	/**
+	 * Add a quad, by default covering the whole texture.
+	 * @param uv0 Texture coordinate of the top left corner.
+	 * @param uv1 Texture coordinate of the bottom right corner.
+	 */
+	void add(unsigned int texture, const Vector2f& pos, const Vector2f& size, const Color& color = Color::white,
+	         const Vector2f& uv0 = Vector2f(0,0), const Vector2f& uv1 = Vector2f(1,1));
+
+	/**
+	 * Merge the groups into a single vertex array, call after the last add.
+	 */
+	void build();
+
+	/**
+	 * Vertices in draw order (valid after build).
+	 */
+	const std::vector<Vertex>& vertices() const { return _vertices; }
+
+	/**
+	 * One entry per draw call (valid after build).
+	 */
+	const std::vector<Run>& runs() const { return _runs; }
+
+	/**
+	 * Number of quads added since clear.
+	 */
+	size_t size() const { return num_quads; }
+
+private:
+	struct Group {
+		unsigned int texture;
+		Vector2f min;
+		Vector2f max;
+		std::vector<Vertex> vertices;
+	};
+
+	/**
+	 * Find the group the quad can be appended to, or NULL if a new group is
+	 * needed.
+	 */
+	Group* find_group(unsigned int texture, const Vector2f& min, const Vector2f& max);
+
+	std::vector<Group> groups;
+	size_t num_groups;          /* groups in use, the rest is kept to reuse their memory */
+	size_t num_quads;
+	std::vector<Vertex> _vertices;
+	std::vector<Run> _runs;
+};
+
+#endif /* FROBNICATOR_SPRITE_BATCH_H */
@@ -0,0 +1,131 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: task(nullptr)
+	, remaining(0)
+	, generation(0)
+	, stopping(false) {
+
+	if ( threads == 0 ){
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+
+	for ( unsigned int i = 0; i < threads; i++ ){
+		queue.push_back(new Queue);
+	}
+
+	for ( unsigned int i = 1; i < threads; i++ ){
+		thread.push_back(std::thread(&ThreadPool::worker, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for ( auto it = thread.begin(); it != thread.end(); ++it ){
+		it->join();
+	}
+
+	for ( auto it = queue.begin(); it != queue.end(); ++it ){
+		delete *it;
+	}
+}
+
+void ThreadPool::parallel_for(size_t n, size_t grain, const Task& task){
+	grain = std::max(grain, (size_t)1);
+	if ( size() == 1 || n <= grain ){
+		if ( n > 0 ) task(0, n);
+		return;
+	}
+
+	/* deal chunks out round-robin so each thread starts with a contiguous share */
+	const size_t chunks = (n + grain - 1) / grain;
+	const size_t per_thread = (chunks + size() - 1) / size();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		this->task = &task;
+		remaining = chunks;
+
+		size_t begin = 0;
+		for ( unsigned int i = 0; i < size() && begin < n; i++ ){
+			std::lock_guard<std::mutex> queue_guard(queue[i]->lock);
+			for ( size_t j = 0; j < per_thread && begin < n; j++ ){
+				const size_t end = std::min(begin + grain, n);
+				queue[i]->ranges.push_back(Range(begin, end));
+				begin = end;
+			}
+		}
+
+		generation++;
+	}
+	wake.notify_all();
+
+	while ( run_one(0) );
+
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this](){ return remaining == 0; });
+	this->task = nullptr;
+}
+
+/**
+ * Run a chunk from the own queue or steal one from another thread.
+ * @return false if all queues are empty.
+ */
+bool ThreadPool::run_one(unsigned int self){
+	Range range;
+	bool found = false;
+
+	for ( unsigned int i = 0; i < size() && !found; i++ ){
+		const unsigned int victim = (self + i) % size();
+		Queue& q = *queue[victim];
+
+		std::lock_guard<std::mutex> guard(q.lock);
+		if ( q.ranges.empty() ) continue;
+
+		if ( victim == self ){
+			range = q.ranges.front();
+			q.ranges.pop_front();
+		} else {
+			range = q.ranges.back();
+			q.ranges.pop_back();
+		}
+		found = true;
+	}
+
+	if ( !found ){
+		return false;
+	}
+
+	(*task)(range.first, range.second);
+
+	if ( --remaining == 0 ){
+		std::lock_guard<std::mutex> guard(lock);
+		done.notify_all();
+	}
+
+	return true;
+}
+
+void ThreadPool::worker(unsigned int self){
+	unsigned long seen = 0;
+
+	for (;;){
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this, seen](){ return stopping || generation != seen; });
+			if ( stopping ) return;
+			seen = generation;
+		}
+
+		while ( run_one(self) );
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef FROBNICATOR_THREAD_POOL_H
+#define FROBNICATOR_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running data-parallel loops.
+ *
+ * parallel_for splits the range into chunks which are dealt out to one queue
+ * per thread. Each thread takes chunks from the front of its own queue and
+ * when it runs dry steals from the back of the others, so uneven chunks are
+ * balanced out. The calling thread takes part and the call returns once all
+ * chunks are done.
+ *
+ * Chunks run in no particular order and concurrently, so the task must only
+ * write to state owned by the indices it is given. Results are then the same
+ * regardless of the number of threads.
+ */
+class ThreadPool {
+public:
+	typedef std::function<void(size_t begin, size_t end)> Task;
+
+	/**
+	 * @param threads Total number of threads including the caller, 0 uses
+	 *                the number of cores.
+	 */
+	explicit ThreadPool(unsigned int threads);
+	~ThreadPool();
+
+	/**
+	 * Number of threads including the caller.
+	 */
+	unsigned int size() const { return queue.size(); }
+
+	/**
+	 * Run task over [0, n) in chunks of (at most) grain indices. Small ranges
+	 * are run directly on the calling thread.
+	 */
+	void parallel_for(size_t n, size_t grain, const Task& task);
+
+private:
+	typedef std::pair<size_t, size_t> Range;
+
+	struct Queue {
+		std::mutex lock;
+		std::deque<Range> ranges;
+	};
+
+	bool run_one(unsigned int self);
+	void worker(unsigned int self);
+
+	std::vector<Queue*> queue; /* one per thread, 0 is the caller */
+	std::vector<std::thread> thread;
+
+	std::mutex lock;
+	std::condition_variable wake;  /* new work or stopping */
+	std::condition_variable done;  /* last chunk finished */
+	const Task* task;
+	std::atomic<size_t> remaining; /* chunks not yet finished */
+	unsigned long generation;      /* bumped for each parallel_for */
+	bool stopping;
+};
+
+#endif /* FROBNICATOR_THREAD_POOL_H */
@@ -3,7 +3,10 @@
 #endif
 
 #include "tilemap.hpp"
+#include "tilemap_format.hpp"
 #include "common.hpp"
+#include "flowfield.hpp"
+#include "keyword.hpp"
 #include "region.hpp"
 #include "spawn.hpp"
 #include "waypoint.hpp"
@@ -11,14 +14,34 @@
 #include <yaml.h>
 #include <vector>
 #include <map>
-
-static const size_t max_tiles = 500;
+#include <math.h>
+#include <algorithm>
+#include <cstring>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #ifdef WIN32
 #define strncasecmp _strnicmp
 #define strncpy(dst, src, n) strncpy_s(dst, n, src, _TRUNCATE)
 #endif
 
+/**
+ * Properties of a tile in the tileset, as given by the tile[..] sections.
+ */
+struct TileInfo {
+	TileInfo()
+		: set(0)
+		, build(0) {}
+
+	uint8_t set;
+	uint8_t build;
+};
+
 class TilemapPimpl {
 public:
 	TilemapPimpl(const std::string& filename)
@@ -28,6 +51,13 @@ public:
 		, tiles_horizontal(0)
 		, tiles_vertical(0)
 		, tiles_size(-1)
+		, slots(0)
+		, inner(0)
+		, tile(NULL)
+		, num_cells(0)
+		, mapping(NULL)
+		, mapping_size(0)
+		, mapped(false)
 		, meta_set(false) {
 
 		const char* real_filename = real_path(filename.c_str());
@@ -39,60 +69,362 @@ public:
 
 		fprintf(stderr, "Loading tilemap `%s'\n", filename.c_str());
 
-		/* reset all tile info */
-		for ( size_t i = 0; i < max_tiles; i++ ){
-			tileinfo[i].set = 0;
-		}
+		/* compiled tilemaps are detected by magic, anything else is parsed as yaml */
+		char magic[sizeof(TilemapFormat::magic)];
+		const bool compiled =
+			fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+			memcmp(magic, TilemapFormat::magic, sizeof(magic)) == 0;
 
-		yaml_parser_t parser;
-		yaml_parser_initialize(&parser);
+		if ( compiled ){
+			fclose(fp);
+			load_compiled(real_filename);
+		} else {
+			rewind(fp);
 
-		yaml_parser_set_input_file(&parser, fp);
-		parse_doc(&parser);
+			yaml_parser_t parser;
+			yaml_parser_initialize(&parser);
 
-		yaml_parser_delete(&parser);
-		fclose(fp);
+			yaml_parser_set_input_file(&parser, fp);
+			parse_doc(&parser);
 
-		/* fill default value for unset tiles */
-		fprintf(stderr, "  preparing tiledata\n");
-		const float dx = 1.0f / tiles_horizontal;
-		const float dy = 1.0f / tiles_vertical;
-		for ( size_t i = 0; i < tiles_size; i++ ){
-			struct Tilemap::Tile& info = tileinfo[i];
+			yaml_parser_delete(&parser);
+			fclose(fp);
 
-			if ( !info.set ){
-				info = default_tile;
+			/* fill default value for unset tiles */
+			fprintf(stderr, "  preparing tiledata\n");
+			tileinfo.resize(tiles_size);
+			for ( size_t i = 0; i < tiles_size; i++ ){
+				if ( !tileinfo[i].set ){
+					tileinfo[i] = default_tile;
+				}
 			}
 
+			fprintf(stderr, "  preprocessing map grid\n");
+			for ( auto it = tile_storage.begin(); it != tile_storage.end(); ++it ){
+				if ( tileinfo[it->index()].build ){
+					it->bits |= Tilemap::Tile::build_bit;
+				}
+			}
+
+			tile = tile_storage.data();
+			num_cells = tile_storage.size();
+		}
+
+		/* texture coordinates, shared by all cells using the same tile */
+		const float dx = 1.0f / tiles_horizontal;
+		const float dy = 1.0f / tiles_vertical;
+		uv.resize(8 * tiles_size);
+		for ( size_t i = 0; i < tiles_size; i++ ){
 			const unsigned int x = i % tiles_horizontal;
 			const unsigned int y = i / tiles_horizontal;
-			info.index = i;
-			float s = x * dx;
-			float t = y * dy;
-			info.uv[0] = s;
-			info.uv[1] = t;
-			info.uv[2] = s + dx;
-			info.uv[3] = t;
-			info.uv[4] = s + dx;
-			info.uv[5] = t + dy;
-			info.uv[6] = s;
-			info.uv[7] = t + dy;
+			const float s = x * dx;
+			const float t = y * dy;
+			float* v = &uv[8*i];
+			v[0] = s;
+			v[1] = t;
+			v[2] = s + dx;
+			v[3] = t;
+			v[4] = s + dx;
+			v[5] = t + dy;
+			v[6] = s;
+			v[7] = t + dy;
 		}
 		fprintf(stderr, "    * %d tiles loaded\n", tiles_size);
+		fprintf(stderr, "    * %zd cells loaded\n", num_cells);
+
+		link_waypoints();
+	}
+
+	~TilemapPimpl(){
+		clear_flow_fields();
+
+#ifdef HAVE_SYS_MMAN_H
+		if ( mapped ){
+			munmap(mapping, mapping_size);
+			return;
+		}
+#endif
+		free(mapping);
+	}
+
+	/**
+	 * Write tilemap in the compiled format (see tilemap_format.hpp).
+	 * @return false if the file could not be written.
+	 */
+	bool save_compiled(const std::string& filename) const {
+		using namespace TilemapFormat;
+
+		/* offset 0 is the empty string */
+		std::vector<char> strings(1, 0);
+		auto add_string = [&strings](const std::string& str) -> uint32_t {
+			if ( str.empty() ) return 0;
+			const uint32_t offset = strings.size();
+			strings.insert(strings.end(), str.begin(), str.end());
+			strings.push_back(0);
+			return offset;
+		};
+		auto align = [](uint64_t offset) -> uint64_t {
+			return (offset + 7) & ~(uint64_t)7;
+		};
+
+		Header header;
+		memset(&header, 0, sizeof(Header));
+		memcpy(header.magic, magic, sizeof(magic));
+		header.version          = version;
+		header.byte_order       = byte_order;
+		header.map_width        = map_width;
+		header.map_height       = map_height;
+		header.tiles_horizontal = tiles_horizontal;
+		header.tiles_vertical   = tiles_vertical;
+		header.slots            = slots;
+		header.inner            = inner;
+		header.title            = add_string(title);
+		header.texture          = add_string(texture_name);
+		header.waves            = add_string(wave_file);
+		header.num_waypoints    = waypoint.size();
+		header.num_spawnpoints  = spawnpoint.size();
+
+		std::vector<RegionRecord> regions;
+		for ( auto it = waypoint.begin(); it != waypoint.end(); ++it ){
+			const Waypoint* wp = it->second;
+			RegionRecord r = {add_string(wp->name()), add_string(wp->next()), add_string(wp->inner()), wp->x(), wp->y(), wp->w(), wp->h(), 0};
+			regions.push_back(r);
+		}
+		for ( auto it = spawnpoint.begin(); it != spawnpoint.end(); ++it ){
+			const Spawnpoint* sp = it->second;
+			RegionRecord r = {add_string(sp->name()), add_string(sp->next), 0, sp->x(), sp->y(), sp->w(), sp->h(), 0};
+			regions.push_back(r);
+		}
+
+		/* layout */
+		header.tileinfo_offset = align(sizeof(Header));
+		header.cells_offset    = align(header.tileinfo_offset + tiles_size);
+		header.regions_offset  = align(header.cells_offset + sizeof(Tilemap::Tile) * map_size);
+		header.strings_offset  = align(header.regions_offset + sizeof(RegionRecord) * regions.size());
+		header.strings_size    = strings.size();
+
+		std::vector<char> data(header.strings_offset + header.strings_size, 0);
+		memcpy(&data[0], &header, sizeof(Header));
+
+		uint8_t* flags = reinterpret_cast<uint8_t*>(&data[header.tileinfo_offset]);
+		for ( size_t i = 0; i < tiles_size; i++ ){
+			flags[i] = tileinfo[i].build ? tileinfo_build : 0;
+		}
+
+		/* missing cells (already warned about) are stored as tile 0 */
+		Tilemap::Tile* cells = reinterpret_cast<Tilemap::Tile*>(&data[header.cells_offset]);
+		for ( size_t i = 0; i < map_size && i < num_cells; i++ ){
+			cells[i] = tile[i];
+		}
+
+		if ( !regions.empty() ){
+			memcpy(&data[header.regions_offset], &regions[0], sizeof(RegionRecord) * regions.size());
+		}
+		memcpy(&data[header.strings_offset], &strings[0], strings.size());
+
+		FILE* fp = fopen(filename.c_str(), "wb");
+		if ( !fp ){
+			fprintf(stderr, "Failed to open `%s' for writing.\n", filename.c_str());
+			return false;
+		}
+
+		const bool ok = fwrite(&data[0], 1, data.size(), fp) == data.size();
+		if ( fclose(fp) != 0 || !ok ){
+			fprintf(stderr, "Failed to write `%s'.\n", filename.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Assign ids to waypoints (in name order) and resolve next/inner names.
+	 */
+	void link_waypoints(){
+		waypoint_list.clear();
+		for ( auto it = waypoint.begin(); it != waypoint.end(); ++it ){
+			waypoint_list.push_back(it->second);
+		}
+
+		int id = 0;
+		for ( auto it = waypoint.begin(); it != waypoint.end(); ++it ){
+			Waypoint* wp = it->second;
+			auto inner = waypoint.find(wp->inner());
+			auto next = waypoint.find(wp->next());
+			wp->link(id++,
+			         inner != waypoint.end() ? inner->second : NULL,
+			         next  != waypoint.end() ? next->second  : NULL);
+		}
+
+		flow_field.assign(waypoint_list.size(), NULL);
+	}
+
+	/* drop all flow fields, they are recomputed when next requested */
+	void clear_flow_fields(){
+		for ( auto it = flow_field.begin(); it != flow_field.end(); ++it ){
+			delete *it;
+		}
+		flow_field.assign(waypoint_list.size(), NULL);
+	}
+
+	/**
+	 * Build table of which waypoints overlap each tile. Requires tile
+	 * dimensions so it is done when the backend sets them.
+	 */
+	void build_region_lookup(){
+		region_offset.assign(map_size + 1, 0);
+		region_lookup.clear();
+
+		for ( unsigned int i = 0; i < map_size; i++ ){
+			/* tile bounds, with a margin as positions are truncated to tiles using floats */
+			const int x0 = (int)((i % map_width) * tile_width) - 1;
+			const int y0 = (int)((i / map_width) * tile_height) - 1;
+			const int x1 = x0 + (int)tile_width + 2;
+			const int y1 = y0 + (int)tile_height + 2;
+
+			/* stored in name order so the first match is the same as a scan of all waypoints */
+			for ( auto it = waypoint_list.begin(); it != waypoint_list.end(); ++it ){
+				const Waypoint* wp = *it;
+				if ( wp->x() + wp->w() < x0 || wp->x() > x1 ) continue;
+				if ( wp->y() + wp->h() < y0 || wp->y() > y1 ) continue;
+				region_lookup.push_back(wp);
+			}
 
-		fprintf(stderr, "  preprocessing map grid\n");
-		int n = 0;
-		for ( auto it = tile.begin(); it != tile.end(); ++it ){
-			Tilemap::Tile& tile = *it;
-			tile = tileinfo[tile.index];
-			tile.x = n % map_width;
-			tile.y = n / map_width;
-			n++;
+			region_offset[i+1] = region_lookup.size();
 		}
-		fprintf(stderr, "    * %zd cells loaded\n", tile.size());
 	}
 
 private:
+	/**
+	 * Map the whole file into memory, falls back to reading it if mmap is
+	 * unavailable. The mapping is private so reserving cells only modifies the
+	 * pages touched, never the file.
+	 */
+	void map_file(const char* filename){
+#ifdef HAVE_SYS_MMAN_H
+		const int fd = open(filename, O_RDONLY);
+		struct stat st;
+		if ( fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0 ){
+			void* addr = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if ( addr != MAP_FAILED ){
+				mapping = addr;
+				mapping_size = st.st_size;
+				mapped = true;
+				close(fd);
+				return;
+			}
+		}
+		if ( fd != -1 ) close(fd);
+#endif
+
+		FILE* fp = fopen(filename, "rb");
+		if ( !fp ){
+			fprintf(stderr, "Failed to load tilemap `%s'\n", filename);
+			exit(1);
+		}
+
+		fseek(fp, 0, SEEK_END);
+		const long size = ftell(fp);
+		rewind(fp);
+
+		mapping = malloc(size > 0 ? size : 1);
+		mapping_size = size > 0 ? size : 0;
+		if ( fread(mapping, 1, mapping_size, fp) != mapping_size ){
+			fprintf(stderr, "Failed to read tilemap `%s'\n", filename);
+			exit(1);
+		}
+		fclose(fp);
+	}
+
+	static void corrupt(const char* filename, const char* what){
+		fprintf(stderr, "Compiled tilemap `%s' is invalid: %s\n", filename, what);
+		exit(1);
+	}
+
+	/**
+	 * Load compiled tilemap, the cell array is used in place.
+	 */
+	void load_compiled(const char* filename){
+		using namespace TilemapFormat;
+
+		fprintf(stderr, "  mapping compiled tilemap\n");
+		map_file(filename);
+
+		char* data = static_cast<char*>(mapping);
+		const Header* header = reinterpret_cast<const Header*>(data);
+
+		if ( mapping_size < sizeof(Header) ) corrupt(filename, "truncated header");
+		if ( header->version != version ) corrupt(filename, "unsupported version, recompile it");
+		if ( header->byte_order != byte_order ) corrupt(filename, "compiled with other byte order, recompile it");
+
+		/* products are computed in 64 bits so a damaged header cannot wrap
+		 * them into passing the section checks below, indices into the map
+		 * are also used as int so keep them within that */
+		const uint64_t cells = (uint64_t)header->map_width * header->map_height;
+		const uint64_t tiles = (uint64_t)header->tiles_horizontal * header->tiles_vertical;
+		if ( cells == 0 || tiles == 0 ) corrupt(filename, "zero dimensions");
+		if ( cells > INT32_MAX || tiles > INT32_MAX ) corrupt(filename, "dimensions too large");
+
+		map_width        = header->map_width;
+		map_height       = header->map_height;
+		map_size         = cells;
+		tiles_horizontal = header->tiles_horizontal;
+		tiles_vertical   = header->tiles_vertical;
+		tiles_size       = tiles;
+		slots            = header->slots;
+		inner            = header->inner;
+		meta_set         = true;
+
+		/* validate sections before touching them */
+		const uint64_t num_regions = (uint64_t)header->num_waypoints + header->num_spawnpoints;
+		const auto inside = [this](uint64_t offset, uint64_t size){
+			return offset <= mapping_size && size <= mapping_size - offset;
+		};
+		if ( !inside(header->tileinfo_offset, tiles_size) ) corrupt(filename, "tileinfo out of bounds");
+		if ( !inside(header->cells_offset, sizeof(Tilemap::Tile) * (uint64_t)map_size) ) corrupt(filename, "cells out of bounds");
+		if ( !inside(header->regions_offset, sizeof(RegionRecord) * num_regions) ) corrupt(filename, "regions out of bounds");
+		if ( !inside(header->strings_offset, header->strings_size) ) corrupt(filename, "strings out of bounds");
+		if ( header->cells_offset % 8 || header->regions_offset % 8 ) corrupt(filename, "unaligned section");
+
+		const char* strings = data + header->strings_offset;
+		const uint64_t strings_size = header->strings_size;
+		if ( strings_size == 0 || strings[strings_size-1] != 0 ) corrupt(filename, "unterminated string table");
+		const auto str = [strings, strings_size](uint32_t offset) -> std::string {
+			return offset < strings_size ? std::string(strings + offset) : std::string();
+		};
+
+		title        = str(header->title);
+		texture_name = str(header->texture);
+		wave_file    = str(header->waves);
+
+		fprintf(stderr, "    * tile size: %dx%d (%d)\n", map_width, map_height, map_size);
+		fprintf(stderr, "    * num tiles: %dx%d (%d)\n", tiles_horizontal, tiles_vertical, tiles_size);
+		fprintf(stderr, "    * texture: %s\n", texture_name.c_str());
+
+		const uint8_t* flags = reinterpret_cast<const uint8_t*>(data + header->tileinfo_offset);
+		tileinfo.resize(tiles_size);
+		for ( size_t i = 0; i < tiles_size; i++ ){
+			tileinfo[i].build = (flags[i] & tileinfo_build) ? 1 : 0;
+			tileinfo[i].set = 1;
+		}
+
+		/* cells are stored exactly as Tilemap::Tile and used in place */
+		tile = reinterpret_cast<Tilemap::Tile*>(data + header->cells_offset);
+		num_cells = map_size;
+
+		const RegionRecord* region = reinterpret_cast<const RegionRecord*>(data + header->regions_offset);
+		for ( uint32_t i = 0; i < header->num_waypoints; i++, region++ ){
+			Waypoint* wp = Waypoint::create(str(region->name), region->x, region->y, region->w, region->h, str(region->next), str(region->inner));
+			waypoint[wp->name()] = wp;
+		}
+		for ( uint32_t i = 0; i < header->num_spawnpoints; i++, region++ ){
+			Spawnpoint* sp = Spawnpoint::create(str(region->name), region->x, region->y, region->w, region->h, str(region->next));
+			spawnpoint[sp->name()] = sp;
+		}
+		fprintf(stderr, "    * %zd waypoints loaded\n", waypoint.size());
+		fprintf(stderr, "    * %zd spawnpoints loaded\n", spawnpoint.size());
+	}
+
 	void parse_doc(yaml_parser_t* parser){
 		yaml_event_t event;
 		yaml_parser_parse(parser, &event) || yaml_error(parser);
@@ -126,36 +458,42 @@ private:
 				abort();
 			}
 
-			const char* inkey = (const char*)event.data.scalar.value;
-			const size_t len = event.data.scalar.length;
-
-			/* key is not null-terminated */
-			char key[64]; /* variable sized array not supported, using max 64 bytes which should be enough */
-			if ( len > 63 ) abort(); /* 63 because null-terminator must fit into array */
-			sprintf(key, "%.*s", (int)len, inkey); /* using sprintf to always get a null-terminator, strcpy might not always add one */
+			const ScalarView key(event);
 
 			/* Fill level with info */
-			if ( strcmp("meta", key) == 0 ){
+			switch ( Keyword::lookup(key) ){
+			case Keyword::META:
 				parse_meta(parser);
-			} else if ( strcmp("data", key) == 0 ){
+				break;
+			case Keyword::DATA:
 				parse_data(parser);
-			} else if ( strncmp("tile", key, 4) == 0 || strcmp("default", key) == 0 ){
+				break;
+			case Keyword::DEFAULT:
 				parse_tileinfo(parser, key);
-			} else if ( strcmp("waypoint", key) == 0 ){
+				break;
+			case Keyword::WAYPOINT:
 				fprintf(stderr, "  parsing waypoints\n");
 				parse_region<Waypoint>(parser, [this](Waypoint* wp){
 					waypoint[wp->name()] = wp;
 				});
 				fprintf(stderr, "    * %zd waypoints loaded\n", waypoint.size());
-			} else if ( strcmp("spawn", key) == 0 ){
+				break;
+			case Keyword::SPAWN:
 				fprintf(stderr, "  parsing spawnpoints\n");
 				parse_region<Spawnpoint>(parser, [this](Spawnpoint* r){
 					spawnpoint[r->name()] = r;
 				});
 				fprintf(stderr, "    * %zd spawnpoints loaded\n", spawnpoint.size());
-			} else {
+				break;
+			default:
+				/* tile sections are named by range, e.g. tile[3-7] */
+				if ( key.starts_with("tile") ){
+					parse_tileinfo(parser, key);
+					break;
+				}
+
 				/* warning only */
-				fprintf(stderr, "  - Unhandled key `%.*s'\n", (int)len, key);
+				fprintf(stderr, "  - Unhandled key `%.*s'\n", (int)key.size(), key.data());
 			}
 		} while ( true );
 	}
@@ -186,26 +524,26 @@ private:
 				abort();
 			}
 
-			const std::string key((const char*)ekey.data.scalar.value, ekey.data.scalar.length);
+			const ScalarView key(ekey);
 
 			/* Parse value */
 			yaml_parser_parse(parser, &evalue) || yaml_error(parser);
-			const char* value = (const char*)evalue.data.scalar.value;
-			const size_t len = evalue.data.scalar.length;
+			const ScalarView value(evalue);
 
 			/* Fill level with info */
-			if ( key == "width"            ){ map_width = atoi(value);
-			} else if ( key == "height"           ){ map_height = atoi(value);
-			} else if ( key == "tiles_horizontal" ){ tiles_horizontal = atoi(value);
-			} else if ( key == "tiles_vertical"   ){ tiles_vertical = atoi(value);
-			} else if ( key == "texture"          ){ texture_name = std::string(value, len);
-			} else if ( key == "title"            ){ title = std::string(value, len);
-			} else if ( key == "waves"            ){ wave_file = std::string(value, len);
-			} else if ( key == "slots"            ){ slots = atoi(value);
-			} else if ( key == "inner"            ){ inner = atoi(value);
-			} else {
+			switch ( Keyword::lookup(key) ){
+			case Keyword::WIDTH:            map_width = value.to_int(); break;
+			case Keyword::HEIGHT:           map_height = value.to_int(); break;
+			case Keyword::TILES_HORIZONTAL: tiles_horizontal = value.to_int(); break;
+			case Keyword::TILES_VERTICAL:   tiles_vertical = value.to_int(); break;
+			case Keyword::TEXTURE:          texture_name = value.str(); break;
+			case Keyword::TITLE:            title = value.str(); break;
+			case Keyword::WAVES:            wave_file = value.str(); break;
+			case Keyword::SLOTS:            slots = value.to_int(); break;
+			case Keyword::INNER:            inner = value.to_int(); break;
+			default:
 				/* warning only */
-				fprintf(stderr, "    - Unhandled key `%s'\n", key.c_str());
+				fprintf(stderr, "    - Unhandled key `%.*s'\n", (int)key.size(), key.data());
 			}
 		} while ( true );
 
@@ -213,8 +551,8 @@ private:
 		tiles_size = tiles_horizontal * tiles_vertical;
 		meta_set = true;
 
-		if ( tiles_size >= max_tiles ){
-			fprintf(stderr, "too many tiles, max is %zd\n", max_tiles);
+		if ( tiles_size > Tilemap::Tile::index_mask ){
+			fprintf(stderr, "too many tiles, max is %u\n", Tilemap::Tile::index_mask);
 			abort();
 		}
 
@@ -223,8 +561,8 @@ private:
 		fprintf(stderr, "    * texture: %s\n", texture_name.c_str());
 	}
 
-	void parse_tileinfo(yaml_parser_t* parser, char* tilerange){
-		struct Tilemap::Tile cur;
+	void parse_tileinfo(yaml_parser_t* parser, const ScalarView& tilerange){
+		TileInfo cur;
 
 		/* Ensure meta is a dict */
 		yaml_event_t event;
@@ -250,50 +588,55 @@ private:
 				abort();
 			}
 
-			const char* key = (const char*)ekey.data.scalar.value;
-			const size_t len = ekey.data.scalar.length;
+			const ScalarView key(ekey);
 
 			/* Parse value */
 			yaml_parser_parse(parser, &evalue) || yaml_error(parser);
 
 			/* Fill level with info */
-			if ( strncmp("build", key, len) == 0 ){
+			if ( Keyword::lookup(key) == Keyword::BUILD ){
 				cur.build = parse_bool(&evalue);
 			} else {
 				/* warning only */
-				fprintf(stderr, "Unhandled key `%.*s'\n", (int)len, key);
+				fprintf(stderr, "Unhandled key `%.*s'\n", (int)key.size(), key.data());
 			}
 		} while ( true );
 
-		if ( strcmp(tilerange, "default") == 0 ){
+		if ( tilerange == "default" ){
 			default_tile = cur;
 			return;
 		}
 
 		/* cut "tile[" prefix */
-		tilerange += 5;
+		const char* range = tilerange.data() + 5;
 
 		/* ensure range is digits */
-		if ( !isdigit(tilerange[0]) ){
-			fprintf(stderr, "invalid tile range: `%s', ignored\n", tilerange);
+		if ( tilerange.size() <= 5 || !isdigit(range[0]) ){
+			fprintf(stderr, "invalid tile range: `%.*s', ignored\n", (int)tilerange.size(), tilerange.data());
 			return;
 		}
 
 		/* determine range */
-		unsigned int lower;
-		unsigned int upper;
-		char* delim = strchr(tilerange, '-');
-		if ( !delim ){ /* single tile only */
-			const int index = atoi(tilerange);
-			lower = upper = index;
-		} else {
-			*delim++ = 0;
-			lower = atoi(tilerange);
-			upper = atoi(delim);
+		char* delim;
+		unsigned int lower = strtoul(range, &delim, 10);
+		unsigned int upper = lower; /* single tile only */
+		if ( *delim == '-' ){
+			upper = strtoul(delim + 1, NULL, 10);
 		}
 
-		if ( lower > upper || upper > max_tiles ){
-			fprintf(stderr, "  invalid tile range %d-%d, must be min <= max <= %zd\n", lower, upper, max_tiles);
+		if ( lower > upper || upper > Tilemap::Tile::index_mask ){
+			fprintf(stderr, "  invalid tile range %u-%u, must be min <= max <= %u, ignored\n", lower, upper, Tilemap::Tile::index_mask);
+			return;
+		}
+
+		/* tiles outside of the tileset are never used */
+		if ( meta_set && upper >= tiles_size ){
+			if ( lower >= tiles_size ) return;
+			upper = tiles_size - 1;
+		}
+
+		if ( upper >= tileinfo.size() ){
+			tileinfo.resize(upper + 1);
 		}
 
 		for ( unsigned int i = lower; i <= upper; i++ ){
@@ -373,14 +716,14 @@ private:
 			}();
 
 			Tilemap::Tile tmp;
-			tmp.index = index;
-			tile.push_back(tmp);
+			tmp.bits = index;
+			tile_storage.push_back(tmp);
 		} while (true);
 
 		/* warn if there was an unexpected number of tiles */
-		if ( tile.size() < map_size ){
+		if ( tile_storage.size() < map_size ){
 			fprintf(stderr, "warning: too few tiles in data\n");
-		} else if ( tile.size() > map_size ){
+		} else if ( tile_storage.size() > map_size ){
 			fprintf(stderr, "warning: too many tiles in data\n");
 		}
 	}
@@ -426,15 +769,25 @@ public:
 	std::string wave_file;         /* wave definition file */
 	unsigned int slots;            /* number of players supported */
 	int inner;                     /* if >0 defines how many waypoints to move to before jumping into inner circle */
-	std::vector<Tilemap::Tile> tile;
+	Tilemap::Tile* tile;           /* all cells, points into tile_storage or the mapped file */
+	size_t num_cells;
+	std::vector<float> uv;         /* texture coordinates, 8 floats per tile index */
 	std::string texture_name;
 	std::map<std::string, Waypoint*> waypoint;
 	std::map<std::string, Spawnpoint*> spawnpoint;
+	std::vector<const Waypoint*> waypoint_list;  /* indexed by waypoint id */
+	std::vector<const Waypoint*> region_lookup;  /* waypoints overlapping each tile, see region_offset */
+	std::vector<unsigned int> region_offset;     /* first entry in region_lookup for each tile, map_size+1 elements */
+	std::vector<FlowField*> flow_field;          /* indexed by waypoint id, NULL until requested */
 
 private:
+	std::vector<Tilemap::Tile> tile_storage; /* cells parsed from yaml */
+	std::vector<TileInfo> tileinfo;          /* indexed by tile index */
+	void* mapping;                           /* compiled tilemap file */
+	size_t mapping_size;
+	bool mapped;                             /* true if mapping is mmap:ed, otherwise malloc:ed */
 	bool meta_set;
-	struct Tilemap::Tile default_tile;
-	struct Tilemap::Tile tileinfo[max_tiles]; /* fulhack */
+	TileInfo default_tile;
 };
 
 Tilemap::Tilemap(const std::string& filename)
@@ -442,7 +795,11 @@ Tilemap::Tilemap(const std::string& filename)
 }
 
 Tilemap::~Tilemap(){
+	delete pimpl;
+}
 
+bool Tilemap::save_compiled(const std::string& filename) const {
+	return pimpl->save_compiled(filename);
 }
 
 size_t Tilemap::size() const {
@@ -474,40 +831,87 @@ const Tilemap::Tile& Tilemap::operator[](unsigned int i) const {
 }
 
 const Tilemap::Tile& Tilemap::at(unsigned int x, unsigned int y) const {
-	const unsigned int index = x + y * pimpl->map_width;
+	static const Tile outside = {0};
+
+	const size_t index = x + (size_t)y * pimpl->map_width;
+	if ( x >= pimpl->map_width || index >= pimpl->num_cells ){
+		return outside;
+	}
+
 	return pimpl->tile[index];
 }
 
-void Tilemap::reserve(const Vector2i& pos, const Vector2i& size){
-	for ( int x = pos.x; x < pos.x + size.x; x++ ){
-		for ( int y = pos.y; y < pos.y + size.y; y++ ){
-			pimpl->tile[x + y * pimpl->map_width].build = 0;
+const float* Tilemap::uv(unsigned int index) const {
+	static const float none[8] = {0};
+	if ( 8 * (size_t)index >= pimpl->uv.size() ) return none;
+	return &pimpl->uv[8 * index];
+}
+
+/**
+ * Mark or free all cells in the area, cells outside of the map are ignored.
+ */
+static void set_reserved(TilemapPimpl* pimpl, const Vector2i& pos, const Vector2i& size, bool reserved){
+	for ( int x = std::max(pos.x, 0); x < pos.x + size.x && x < (int)pimpl->map_width; x++ ){
+		for ( int y = std::max(pos.y, 0); y < pos.y + size.y; y++ ){
+			const size_t index = x + (size_t)y * pimpl->map_width;
+			if ( index >= pimpl->num_cells ) break;
+
+			Tilemap::Tile& tile = pimpl->tile[index];
+			if ( reserved ){
+				tile.bits &= ~Tilemap::Tile::build_bit;
+				tile.bits |= Tilemap::Tile::blocked_bit;
+			} else {
+				tile.bits |= Tilemap::Tile::build_bit;
+				tile.bits &= ~Tilemap::Tile::blocked_bit;
+			}
 		}
 	}
 }
 
+void Tilemap::reserve(const Vector2i& pos, const Vector2i& size){
+	set_reserved(pimpl, pos, size, true);
+}
+
 void Tilemap::unreserve(const Vector2i& pos, const Vector2i& size){
-	for ( int x = pos.x; x < pos.x + size.x; x++ ){
-		for ( int y = pos.y; y < pos.y + size.y; y++ ){
-			pimpl->tile[x + y * pimpl->map_width].build = 1;
+	set_reserved(pimpl, pos, size, false);
+}
+
+void Tilemap::reroute(const Vector2i& pos, const Vector2i& size, bool reserved){
+	for ( auto it = pimpl->flow_field.begin(); it != pimpl->flow_field.end(); ++it ){
+		if ( !*it ) continue;
+		if ( reserved ){
+			(*it)->block(pos, size);
+		} else {
+			(*it)->unblock(pos, size);
 		}
 	}
 }
 
-std::vector<Tilemap::Tile>::iterator Tilemap::begin(){
-	return pimpl->tile.begin();
+const FlowField* Tilemap::flow_field(int id) const {
+	const Waypoint* goal = waypoint(id);
+	if ( !goal ) return NULL;
+
+	FlowField*& field = pimpl->flow_field[id];
+	if ( !field ){
+		field = new FlowField(*this, *goal);
+	}
+	return field;
 }
 
-std::vector<Tilemap::Tile>::iterator Tilemap::end(){
-	return pimpl->tile.end();
+Tilemap::Tile* Tilemap::begin(){
+	return pimpl->tile;
 }
 
-std::vector<Tilemap::Tile>::const_iterator Tilemap::begin() const {
-	return pimpl->tile.begin();
+Tilemap::Tile* Tilemap::end(){
+	return pimpl->tile + pimpl->num_cells;
 }
 
-std::vector<Tilemap::Tile>::const_iterator Tilemap::end() const {
-	return pimpl->tile.end();
+const Tilemap::Tile* Tilemap::begin() const {
+	return pimpl->tile;
+}
+
+const Tilemap::Tile* Tilemap::end() const {
+	return pimpl->tile + pimpl->num_cells;
 }
 
 const std::map<std::string, Waypoint*>& Tilemap::waypoints() const {
@@ -518,9 +922,37 @@ const std::map<std::string, Spawnpoint*>& Tilemap::spawnpoints() const {
 	return pimpl->spawnpoint;
 }
 
+const Waypoint* Tilemap::waypoint(int id) const {
+	if ( id < 0 || id >= (int)pimpl->waypoint_list.size() ) return NULL;
+	return pimpl->waypoint_list[id];
+}
+
+const Waypoint* Tilemap::waypoint_at(const Vector2f& pos, const Vector2f& size) const {
+	const int tx = (int)floorf(pos.x / pimpl->tile_width);
+	const int ty = (int)floorf(pos.y / pimpl->tile_height);
+
+	/* outside of map, test all waypoints */
+	if ( tx < 0 || ty < 0 || tx >= (int)pimpl->map_width || ty >= (int)pimpl->map_height ){
+		for ( auto it = pimpl->waypoint_list.begin(); it != pimpl->waypoint_list.end(); ++it ){
+			if ( (*it)->contains(pos, size, true) ) return *it;
+		}
+		return NULL;
+	}
+
+	const unsigned int i = tx + ty * pimpl->map_width;
+	for ( unsigned int j = pimpl->region_offset[i]; j < pimpl->region_offset[i+1]; j++ ){
+		const Waypoint* wp = pimpl->region_lookup[j];
+		if ( wp->contains(pos, size, true) ) return wp;
+	}
+
+	return NULL;
+}
+
 void Tilemap::set_dimensions(size_t w, size_t h){
 	pimpl->tile_width  = w / pimpl->tiles_horizontal;
 	pimpl->tile_height = h / pimpl->tiles_vertical;
+	pimpl->build_region_lookup();
+	pimpl->clear_flow_fields(); /* goals depend on the tile size */
 }
 
 const std::string& Tilemap::title() const {
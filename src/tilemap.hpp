@@ -12,17 +12,22 @@
 class Tilemap {
 public:
 	/**
-	 * Tile data.
+	 * Per-cell data, packed into 32 bits: the tileinfo index in the lower 30
+	 * bits, whenever the cell is blocked by a building and whenever the cell
+	 * is buildable in the top bit. Data shared by all cells using the same
+	 * tileinfo (such as texture coordinates) is looked up by index, see uv().
+	 * The position is implied by the cell index.
 	 */
 	struct Tile {
-		float uv[8]; /* float uv[2][4] */
+		static const uint32_t index_mask  = 0x3FFFFFFF;
+		static const uint32_t blocked_bit = 0x40000000;
+		static const uint32_t build_bit   = 0x80000000;
 
-		uint8_t x;
-		uint8_t y;
-		uint16_t index;
+		unsigned int index() const { return bits & index_mask; }
+		bool blocked() const { return (bits & blocked_bit) != 0; }
+		bool build() const { return (bits & build_bit) != 0; }
 
-		uint8_t set: 1;
-		uint8_t build: 1;
+		uint32_t bits;
 	};
 
 	virtual ~Tilemap();
@@ -57,20 +62,72 @@ public:
 	int inner() const;
 
 	const Tile& operator[](unsigned int i) const;
+
+	/**
+	 * Get cell at x, y. Positions outside of the map yields a tile which
+	 * cannot be built on.
+	 */
 	const Tile& at(unsigned int x, unsigned int y) const;
+
+	/**
+	 * Texture coordinates for a tileinfo index, four s,t pairs (clockwise
+	 * from top-left).
+	 */
+	const float* uv(unsigned int index) const;
+
+	/**
+	 * Mark area as occupied by a building (not buildable and blocks creep) or
+	 * free it again. Only the tile flags change, call reroute() afterwards.
+	 */
 	void reserve(const Vector2i& pos, const Vector2i& size);
 	void unreserve(const Vector2i& pos, const Vector2i& size);
+
+	/**
+	 * Update flow fields to route around an area after reserve(), or through
+	 * it again after unreserve(). Only reads tiles, so it may run while other
+	 * threads read the tilemap.
+	 */
+	void reroute(const Vector2i& pos, const Vector2i& size, bool reserved);
+
+	/**
+	 * Get the flow field leading creep to a waypoint, computed the first time
+	 * it is requested.
+	 * @return Field or NULL if id is out of range.
+	 */
+	const FlowField* flow_field(int id) const;
+
 	const std::string& texture_filename() const;
 	void set_dimensions(size_t w, size_t h);
 
-	std::vector<Tile>::iterator begin();
-	std::vector<Tile>::iterator end();
-	std::vector<Tile>::const_iterator begin() const;
-	std::vector<Tile>::const_iterator end() const;
+	Tile* begin();
+	Tile* end();
+	const Tile* begin() const;
+	const Tile* end() const;
 
 	const std::map<std::string, Waypoint*>& waypoints() const;
+
+	/**
+	 * Get waypoint by id.
+	 * @return Waypoint or NULL if id is out of range.
+	 */
+	const Waypoint* waypoint(int id) const;
+
+	/**
+	 * Find the waypoint which completely contains the AABB at pos. If several
+	 * does the first by name is returned. Uses a per-tile lookup table so only
+	 * waypoints overlapping the tile at pos are tested.
+	 * @return Waypoint or NULL if not inside any waypoint.
+	 */
+	const Waypoint* waypoint_at(const Vector2f& pos, const Vector2f& size) const;
 	const std::map<std::string, Spawnpoint*>& spawnpoints() const;
 
+	/**
+	 * Write tilemap in the compiled binary format. Compiled tilemaps are
+	 * detected when loading and mapped directly instead of being parsed.
+	 * @return false if the file could not be written.
+	 */
+	bool save_compiled(const std::string& filename) const;
+
 protected:
 	Tilemap(const std::string& filename);
 
@@ -0,0 +1,69 @@
+#ifndef FROBNICATOR_TILEMAP_FORMAT_H
+#define FROBNICATOR_TILEMAP_FORMAT_H
+
+#include <stdint.h>
+
+/**
+ * On-disk layout of compiled tilemaps (see frobnicator-tilemapc). The file is
+ * meant to be mapped into memory and used in place so all sections are
+ * aligned to 8 bytes and stored in host byte order (the loader rejects files
+ * compiled with another byte order).
+ *
+ *   Header
+ *   tileinfo  uint8_t[tiles_horizontal * tiles_vertical]        (tileinfo_build etc)
+ *   cells     Tilemap::Tile[map_width * map_height]             (index, blocked and build bits)
+ *   regions   RegionRecord[num_waypoints + num_spawnpoints]     (waypoints first)
+ *   strings   NUL-terminated strings referenced by offset into the section
+ */
+namespace TilemapFormat {
+	static const char magic[8] = {'F', 'R', 'O', 'B', 'T', 'M', 'A', 'P'};
+	static const uint32_t version = 3;
+	static const uint32_t byte_order = 0x01020304;
+
+	/* tileinfo flags */
+	static const uint8_t tileinfo_build = 1 << 0;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+
+		uint32_t map_width;
+		uint32_t map_height;
+		uint32_t tiles_horizontal;
+		uint32_t tiles_vertical;
+		uint32_t slots;
+		int32_t inner;
+
+		/* string offsets */
+		uint32_t title;
+		uint32_t texture;
+		uint32_t waves;
+
+		uint32_t num_waypoints;
+		uint32_t num_spawnpoints;
+		uint32_t reserved;
+
+		/* section offsets from start of file */
+		uint64_t tileinfo_offset;
+		uint64_t cells_offset;
+		uint64_t regions_offset;
+		uint64_t strings_offset;
+		uint64_t strings_size;
+	};
+
+	struct RegionRecord {
+		/* string offsets */
+		uint32_t name;
+		uint32_t next;
+		uint32_t inner; /* waypoints only */
+
+		int32_t x;
+		int32_t y;
+		int32_t w;
+		int32_t h;
+		uint32_t reserved;
+	};
+}
+
+#endif /* FROBNICATOR_TILEMAP_FORMAT_H */
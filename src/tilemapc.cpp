@@ -0,0 +1,51 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * Offline converter from .frob (yaml) tilemaps to the compiled binary format
+ * which the game maps directly into memory.
+ */
+
+#include "tilemap.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+class CompileTilemap: public Tilemap {
+public:
+	CompileTilemap(const std::string& filename)
+		: Tilemap(filename) {}
+};
+
+/**
+ * Tilemaps are normally looked up in the data directory, but the converter
+ * should use paths relative to where it is run.
+ */
+static std::string absolute(const char* filename){
+	if ( filename[0] == '/' ) return filename;
+
+	char cwd[4096];
+	if ( !getcwd(cwd, sizeof(cwd)) ){
+		fprintf(stderr, "Failed to get working directory.\n");
+		exit(1);
+	}
+
+	return std::string(cwd) + "/" + filename;
+}
+
+int main(int argc, const char* argv[]){
+	if ( argc != 3 || strcmp(argv[1], "--help") == 0 ){
+		fprintf(stderr, "usage: %s INPUT.frob OUTPUT\n", argv[0]);
+		return argc == 2 && strcmp(argv[1], "--help") == 0 ? 0 : 1;
+	}
+
+	const CompileTilemap tilemap(absolute(argv[1]));
+	if ( !tilemap.save_compiled(argv[2]) ){
+		return 1;
+	}
+
+	fprintf(stderr, "Wrote `%s'\n", argv[2]);
+	return 0;
+}
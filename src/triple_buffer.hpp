@@ -0,0 +1,75 @@
+#ifndef FROBNICATOR_TRIPLE_BUFFER_H
+#define FROBNICATOR_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/**
+ * Hands values from one writer thread to one reader thread without either
+ * ever waiting for the other.
+ *
+ * There are three slots: the writer owns one, the reader owns one and the
+ * third holds the most recently published value. Publishing swaps the
+ * writer's slot with the middle one and updating swaps the reader's slot with
+ * it, so the reader always gets the latest complete value and values the
+ * reader never saw are simply overwritten.
+ *
+ *   T& out = buffer.write();
+ *   ... fill out ...
+ *   buffer.publish();
+ *
+ *   buffer.update();
+ *   const T& in = buffer.read();
+ *
+ * Slots are reused so values keep their allocations between publishes.
+ */
+template <class T>
+class TripleBuffer {
+public:
+	TripleBuffer()
+		: back(0)
+		, front(1)
+		, middle(2) {}
+
+	/**
+	 * Slot owned by the writer.
+	 */
+	T& write(){
+		return slot[back];
+	}
+
+	/**
+	 * Make the writer's slot the latest value. The writer gets another slot
+	 * with unspecified (older) contents.
+	 */
+	void publish(){
+		back = middle.exchange(back | fresh) & index;
+	}
+
+	/**
+	 * Fetch the latest value if there is one the reader has not seen.
+	 * @return true if read() changed.
+	 */
+	bool update(){
+		if ( !(middle.load() & fresh) ) return false;
+		front = middle.exchange(front) & index;
+		return true;
+	}
+
+	/**
+	 * Slot owned by the reader.
+	 */
+	const T& read() const {
+		return slot[front];
+	}
+
+private:
+	static const unsigned int index = 3;
+	static const unsigned int fresh = 4; /* set when published but not yet read */
+
+	T slot[3];
+	unsigned int back;
+	unsigned int front;
+	std::atomic<unsigned int> middle; /* index of middle slot and fresh bit */
+};
+
+#endif /* FROBNICATOR_TRIPLE_BUFFER_H */
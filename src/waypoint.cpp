@@ -4,7 +4,11 @@
 
 #include "waypoint.hpp"
 
-Waypoint::Waypoint(){
+Waypoint::Waypoint()
+	: _id(-1)
+	, _exit(false)
+	, _inner_wp(NULL)
+	, _next_wp(NULL) {
 
 }
 
@@ -14,8 +18,26 @@ Waypoint* Waypoint::from_yaml(yaml_parser_t* parser){
 	return ptr;
 }
 
-void Waypoint::set(const std::string& key, const std::string& value){
-	     if ( key == "inner" ){ _inner = value; }
-	else if ( key == "next" ){  _next = value; }
-	else { Region::set(key, value); }
+Waypoint* Waypoint::create(const std::string& name, int x, int y, int w, int h,
+                           const std::string& next, const std::string& inner){
+	auto ptr = new Waypoint;
+	ptr->assign(name, x, y, w, h);
+	ptr->_next = next;
+	ptr->_inner = inner;
+	return ptr;
+}
+
+bool Waypoint::set(Keyword::Id key, const ScalarView& value){
+	switch ( key ){
+	case Keyword::INNER: _inner = value.str(); return true;
+	case Keyword::NEXT:  _next = value.str(); return true;
+	default: return Region::set(key, value);
+	}
+}
+
+void Waypoint::link(int id, const Waypoint* inner, const Waypoint* next){
+	_id = id;
+	_exit = name() == "middle";
+	_inner_wp = inner;
+	_next_wp = next;
 }
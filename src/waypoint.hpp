@@ -6,7 +6,9 @@
 class Waypoint: public Region {
 public:
 	static Waypoint* from_yaml(yaml_parser_t* parser);
-	virtual void set(const std::string& key, const std::string& value);
+	static Waypoint* create(const std::string& name, int x, int y, int w, int h,
+	                        const std::string& next, const std::string& inner);
+	virtual bool set(Keyword::Id key, const ScalarView& value);
 
 	/* name of the next inner waypoint */
 	const std::string& inner() const { return _inner; }
@@ -14,12 +16,31 @@ public:
 	/* name of the next waypoint */
 	const std::string& next() const { return _next; }
 
+	/* index in the tilemap waypoint list, -1 until linked */
+	int id() const { return _id; }
+
+	/* creep reaching this waypoint (named "middle") leave the map */
+	bool is_exit() const { return _exit; }
+
+	/* resolved inner and next waypoints, NULL if missing */
+	const Waypoint* inner_waypoint() const { return _inner_wp; }
+	const Waypoint* next_waypoint() const { return _next_wp; }
+
+	/**
+	 * Set id and resolved waypoints, done by tilemap once all waypoints are loaded.
+	 */
+	void link(int id, const Waypoint* inner, const Waypoint* next);
+
 private:
 	Waypoint();
 
 public:
 	std::string _inner;
 	std::string _next;
+	int _id;
+	bool _exit;
+	const Waypoint* _inner_wp;
+	const Waypoint* _next_wp;
 };
 
 #endif /* DVB021_WAYPOINT_H */